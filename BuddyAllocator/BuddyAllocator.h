@@ -1,40 +1,90 @@
 #pragma once
 #include <vector>
 #include <memory>
-#include <list>
-#include <bitset>
+
+#include "MemoryPolicies.h"
+#include "RegionBuddyAllocator.h"
 
 // size is in power of 2s, aka size = 10 is 2^10 bytes
-template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY>
+template <
+    std::size_t MAX_SIZE,
+    std::size_t MIN_SIZE,
+    class THREADING_POLICY,
+    class MEMORY_POLICY = buddy::HeapMemory>
 class BuddyAllocator
 {
 private:
+    using Arena = RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>;
 
-    using LockType = typename THREADING_POLICY::LockType;
-    using ScopedLock = typename THREADING_POLICY::ScopedLock;
+    static constexpr std::size_t LEVELS = MAX_SIZE - MIN_SIZE + 1;
 
-private:
-    std::vector<std::list<std::size_t>> _freeList;
-    std::bitset< (1 << (MAX_SIZE - MIN_SIZE + 1)) / 2 > _freeNodes;
+    static_assert( MAX_SIZE >= MIN_SIZE, "MAX_SIZE must not be smaller than MIN_SIZE" );
+    static_assert( LEVELS <= 256, "levels must fit in the level map entries" );
+
+    static std::size_t metadataSize()
+    {
+        return Arena::metadataSize( buddylib::pow2( MAX_SIZE ), buddylib::pow2( MIN_SIZE ) );
+    }
 
-    std::unique_ptr<uint8_t[]> _memoryPtr;
+    // gives the arena back to the memory policy, also when the constructor throws after reserve()
+    struct ReleaseMemory
+    {
+        void operator()( uint8_t* ptr ) const noexcept
+        {
+            MEMORY_POLICY::release( ptr, buddylib::pow2( MAX_SIZE ) );
+        }
+    };
 
-    LockType _lock;
 private:
-    bool splitToLevel( std::size_t level ) noexcept;
-    void freeNode(std::size_t nodeIdx, std::size_t level) noexcept;
-    void freeNode(std::size_t nodeIdx, std::size_t level, ScopedLock& l) noexcept;
+    std::unique_ptr<uint8_t[], ReleaseMemory> _memory;
+    std::unique_ptr<uint8_t[]> _metadata;
 
-    std::size_t fixSize(std::size_t allocSize) const noexcept;
+    Arena _arena;
 public:
     BuddyAllocator();
 
-    void* allocate( std::size_t size ) noexcept;
-    void deallocate( void* ptr, std::size_t size ) noexcept;
+    BuddyAllocator( BuddyAllocator const& ) = delete;
+    BuddyAllocator& operator=( BuddyAllocator const& ) = delete;
+
+    inline void* allocate( std::size_t size ) noexcept { return _arena.allocate( size ); }
+
+    inline void deallocate( void* ptr, std::size_t size ) noexcept
+    {
+        _arena.deallocate( ptr, size );
+    }
+
+    inline void deallocate( void* ptr ) noexcept { _arena.deallocate( ptr ); }
+
+    inline void* reallocate( void* ptr, std::size_t oldSize, std::size_t newSize ) noexcept
+    {
+        return _arena.reallocate( ptr, oldSize, newSize );
+    }
+
+    inline std::size_t allocateBatch( std::size_t size, std::size_t count, void** out ) noexcept
+    {
+        return _arena.allocateBatch( size, count, out );
+    }
+
+    inline void deallocateBatch( void** ptrs, std::size_t count, std::size_t size ) noexcept
+    {
+        _arena.deallocateBatch( ptrs, count, size );
+    }
+
+    inline bool owns( void const* ptr ) const noexcept { return _arena.owns( ptr ); }
+
+    inline std::size_t allocationSize( void const* ptr ) const noexcept
+    {
+        return _arena.allocationSize( ptr );
+    }
+
+    inline void const* memoryBegin() const noexcept { return _memory.get(); }
 
-    std::vector<std::size_t> freeNodesPerLevel() const noexcept;
+    inline std::vector<std::size_t> freeNodesPerLevel() const noexcept
+    {
+        return _arena.freeNodesPerLevel();
+    }
 
-    ~BuddyAllocator();
+    inline buddy::BuddyStats stats() const noexcept { return _arena.stats(); }
 };
 
 #include "BuddyAllocator.hpp"
@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+#include "BuddyAllocator.h"
+#include "ThreadCaches.h"
+#include "ThreadingPolicies.h"
+
+// Thread local cache of the smallest blocks in front of a shared buddy arena.
+// Each thread keeps a bounded stack of free blocks per cached level, refilled and flushed
+// half a stack at a time through the batch calls of the arena.
+// A thread's caches go back to the arena when the thread exits, possibly while other threads
+// use the allocator, so the arena has to be thread safe.
+// Cached blocks count as live in the arena stats.
+template <
+    std::size_t MAX_SIZE,
+    std::size_t MIN_SIZE,
+    class THREADING_POLICY = buddy::MultiThreaded,
+    class MEMORY_POLICY = buddy::HeapMemory>
+class CachedBuddyAllocator
+{
+public:
+    using Arena = BuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>;
+
+    static constexpr std::size_t CACHED_LEVELS =
+        std::min( std::size_t( 3 ), MAX_SIZE - MIN_SIZE + 1 );
+
+    // blocks per level, refilled and flushed by halves
+    static constexpr std::size_t CACHE_SIZE = 64;
+
+    static constexpr std::size_t MAX_CACHED_SIZE = buddylib::pow2( MIN_SIZE + CACHED_LEVELS - 1 );
+
+private:
+    struct Cache
+    {
+        std::array<std::size_t, CACHED_LEVELS> counts {};
+        std::array<std::array<void*, CACHE_SIZE>, CACHED_LEVELS> blocks;
+    };
+
+    friend class buddylib::ThreadCacheRegistry<CachedBuddyAllocator, Cache>;
+
+    Arena _arena;
+
+    // goes away before the arena, which takes the blocks still cached by other threads along
+    buddylib::ThreadCacheRegistry<CachedBuddyAllocator, Cache> _caches { *this };
+
+private:
+    static std::size_t cacheIndex( std::size_t size ) noexcept
+    {
+        if ( size <= buddylib::pow2( MIN_SIZE ) )
+            return 0;
+        return buddylib::floorLog2( size - 1 ) + 1 - MIN_SIZE;
+    }
+
+    void flush( Cache& cache ) noexcept;
+
+public:
+    CachedBuddyAllocator() = default;
+
+    CachedBuddyAllocator( CachedBuddyAllocator const& ) = delete;
+    CachedBuddyAllocator& operator=( CachedBuddyAllocator const& ) = delete;
+
+    void* allocate( std::size_t size );
+    void deallocate( void* ptr, std::size_t size );
+
+    inline void deallocate( void* ptr ) { deallocate( ptr, _arena.allocationSize( ptr ) ); }
+
+    // returns the blocks cached by the calling thread to the arena
+    void flushThreadCache();
+
+    inline bool owns( void const* ptr ) const noexcept { return _arena.owns( ptr ); }
+
+    inline Arena& arena() noexcept { return _arena; }
+};
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline void CachedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::flush(
+    Cache& cache ) noexcept
+{
+    for ( std::size_t idx = 0; idx < CACHED_LEVELS; ++idx )
+    {
+        _arena.deallocateBatch(
+            cache.blocks[idx].data(), cache.counts[idx], buddylib::pow2( MIN_SIZE + idx ) );
+        cache.counts[idx] = 0;
+    }
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline void* CachedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::allocate(
+    std::size_t size )
+{
+    if ( size > MAX_CACHED_SIZE )
+        return _arena.allocate( size );
+
+    auto cache = _caches.local();
+    if ( !cache )
+        return _arena.allocate( size );
+
+    const auto idx = cacheIndex( size );
+    auto& count = cache->counts[idx];
+    if ( count == 0 )
+    {
+        count = _arena.allocateBatch(
+            buddylib::pow2( MIN_SIZE + idx ), CACHE_SIZE / 2, cache->blocks[idx].data() );
+        if ( count == 0 )
+            return nullptr;
+    }
+    return cache->blocks[idx][--count];
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline void CachedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::deallocate(
+    void* ptr,
+    std::size_t size )
+{
+    if ( size > MAX_CACHED_SIZE )
+    {
+        _arena.deallocate( ptr, size );
+        return;
+    }
+
+    auto cache = _caches.local();
+    if ( !cache )
+    {
+        _arena.deallocate( ptr, size );
+        return;
+    }
+
+    const auto idx = cacheIndex( size );
+    auto& count = cache->counts[idx];
+    auto& blocks = cache->blocks[idx];
+    if ( count == CACHE_SIZE )
+    {
+        // the bottom half was freed the longest ago, the top half is still warm
+        constexpr auto half = CACHE_SIZE / 2;
+        _arena.deallocateBatch( blocks.data(), half, buddylib::pow2( MIN_SIZE + idx ) );
+        std::memmove( blocks.data(), blocks.data() + half, ( count - half ) * sizeof( void* ) );
+        count -= half;
+    }
+    blocks[count++] = ptr;
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline void
+CachedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::flushThreadCache()
+{
+    if ( auto cache = _caches.local() )
+        flush( *cache );
+}
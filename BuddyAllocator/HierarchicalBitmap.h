@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+namespace buddylib
+{
+    using Word = std::uint64_t;
+
+    constexpr std::size_t WORD_BITS = 64;
+    constexpr std::size_t WORD_SHIFT = 6;
+    constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    inline std::size_t countTrailingZeros( Word w )
+    {
+        assert( w != 0 );
+#if defined( _MSC_VER )
+        unsigned long idx;
+        _BitScanForward64( &idx, w );
+        return idx;
+#else
+        return static_cast<std::size_t>( __builtin_ctzll( w ) );
+#endif
+    }
+
+    inline std::size_t floorLog2( Word w )
+    {
+        assert( w != 0 );
+#if defined( _MSC_VER )
+        unsigned long idx;
+        _BitScanReverse64( &idx, w );
+        return idx;
+#else
+        return WORD_BITS - 1 - static_cast<std::size_t>( __builtin_clzll( w ) );
+#endif
+    }
+
+    // Bitmap with summary layers on top, a summary bit is set when the word below it is not zero.
+    // Finding the first set bit costs one count-trailing-zeros per layer.
+    // The bitmap does not own its words so several bitmaps can share one allocation.
+    class HierarchicalBitmap
+    {
+    public:
+        static constexpr std::size_t MAX_LAYERS = 11;  // 64^11 > 2^64
+
+        static std::size_t wordsFor( std::size_t bits )
+        {
+            std::size_t words = 0;
+            do
+            {
+                bits = ( bits + WORD_BITS - 1 ) >> WORD_SHIFT;
+                words += bits;
+            } while ( bits > 1 );
+            return words;
+        }
+
+        void init( Word* words, std::size_t bits )
+        {
+            assert( bits > 0 );
+            std::memset( words, 0, wordsFor( bits ) * sizeof( Word ) );
+            _layerCount = 0;
+            do
+            {
+                assert( _layerCount < MAX_LAYERS );
+                bits = ( bits + WORD_BITS - 1 ) >> WORD_SHIFT;
+                _layers[_layerCount++] = words;
+                words += bits;
+            } while ( bits > 1 );
+        }
+
+        inline bool test( std::size_t idx ) const
+        {
+            return ( _layers[0][idx >> WORD_SHIFT] >> ( idx & ( WORD_BITS - 1 ) ) ) & 1;
+        }
+
+        inline void set( std::size_t idx )
+        {
+            for ( std::size_t layer = 0; layer < _layerCount; ++layer )
+            {
+                auto& word = _layers[layer][idx >> WORD_SHIFT];
+                const bool wasEmpty = word == 0;
+                word |= Word( 1 ) << ( idx & ( WORD_BITS - 1 ) );
+                if ( !wasEmpty )
+                    return;
+                idx >>= WORD_SHIFT;
+            }
+        }
+
+        inline void clear( std::size_t idx )
+        {
+            for ( std::size_t layer = 0; layer < _layerCount; ++layer )
+            {
+                auto& word = _layers[layer][idx >> WORD_SHIFT];
+                word &= ~( Word( 1 ) << ( idx & ( WORD_BITS - 1 ) ) );
+                if ( word != 0 )
+                    return;
+                idx >>= WORD_SHIFT;
+            }
+        }
+
+        inline bool any() const { return _layers[_layerCount - 1][0] != 0; }
+
+        // lowest set bit or npos
+        inline std::size_t findFirst() const
+        {
+            if ( !any() )
+                return npos;
+
+            std::size_t idx = 0;
+            for ( auto layer = _layerCount; layer-- > 0; )
+                idx = ( idx << WORD_SHIFT ) + countTrailingZeros( _layers[layer][idx] );
+            return idx;
+        }
+
+    private:
+        std::array<Word*, MAX_LAYERS> _layers;
+        std::size_t _layerCount = 0;
+    };
+}  // namespace buddylib
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <new>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace buddy
+{
+    // A memory policy provides the arena of a BuddyAllocator.
+    // Every block is handed to commit() before it is returned to the caller, a false return
+    // fails the allocation. Whenever a free block of 2^PURGE_SIZE bytes or more is formed,
+    // its pages are handed to purge().
+    struct HeapMemory
+    {
+        static constexpr std::size_t PURGE_SIZE = std::numeric_limits<std::size_t>::digits;
+
+        static uint8_t* reserve( std::size_t size ) { return new uint8_t[size]; }
+        static void release( uint8_t* ptr, std::size_t ) { delete[] ptr; }
+        static bool commit( void*, std::size_t ) noexcept { return true; }
+        static void purge( void*, std::size_t ) {}
+    };
+
+    // Reserves the arena without committing it, pages are committed on first use
+    // and returned to the OS once they are part of a free block of at least 2^PURGE_SIZE_ bytes.
+    // POSIX systems commit a page when it is first touched. Windows has no lazy commit for
+    // reserved memory, so there commit() commits the pages of each block as it is handed out
+    // and purge() decommits them again.
+    template <std::size_t PURGE_SIZE_ = 16>
+    struct MappedMemory
+    {
+        static_assert( PURGE_SIZE_ >= 12, "purged blocks must cover whole pages" );
+
+        static constexpr std::size_t PURGE_SIZE = PURGE_SIZE_;
+
+        static uint8_t* reserve( std::size_t size )
+        {
+#if defined( _WIN32 )
+            void* ptr = ::VirtualAlloc( nullptr, size, MEM_RESERVE, PAGE_READWRITE );
+            if ( !ptr )
+                throw std::bad_alloc();
+#else
+            void* ptr = ::mmap(
+                nullptr,
+                size,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                -1,
+                0 );
+            if ( ptr == MAP_FAILED )
+                throw std::bad_alloc();
+#endif
+            return static_cast<uint8_t*>( ptr );
+        }
+
+        static void release( uint8_t* ptr, std::size_t size )
+        {
+#if defined( _WIN32 )
+            ( void )size;
+            ::VirtualFree( ptr, 0, MEM_RELEASE );
+#else
+            ::munmap( ptr, size );
+#endif
+        }
+
+        // committing pages that are already committed is a no-op
+        static bool commit( void* ptr, std::size_t size ) noexcept
+        {
+#if defined( _WIN32 )
+            return ::VirtualAlloc( ptr, size, MEM_COMMIT, PAGE_READWRITE ) != nullptr;
+#else
+            ( void )ptr;
+            ( void )size;
+            return true;
+#endif
+        }
+
+        static void purge( void* ptr, std::size_t size )
+        {
+#if defined( _WIN32 )
+            ::VirtualFree( ptr, size, MEM_DECOMMIT );
+#else
+            ::madvise( ptr, size, MADV_DONTNEED );
+#endif
+        }
+    };
+}  // namespace buddy
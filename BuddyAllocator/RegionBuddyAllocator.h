@@ -0,0 +1,191 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+#include "HierarchicalBitmap.h"
+#include "MemoryPolicies.h"
+
+namespace buddy
+{
+    // Snapshot of the allocator counters, levels are indexed from the largest block down.
+    // The levels are read one by one, so a snapshot taken under load is only approximate.
+    struct BuddyStats
+    {
+        static constexpr std::size_t MAX_LEVELS = 64;
+
+        std::size_t levelCount = 0;
+        std::array<std::size_t, MAX_LEVELS> freeBytesPerLevel {};
+
+        std::size_t freeBytes = 0;
+        std::size_t liveBytes = 0;
+        std::size_t largestFreeBlock = 0;
+
+        // allocations that found no block large enough to split
+        std::size_t failedSplits = 0;
+
+        // running totals over all allocations, requested sizes vs the block sizes handed out
+        std::size_t requestedBytes = 0;
+        std::size_t roundedBytes = 0;
+
+        inline double internalFragmentation() const noexcept
+        {
+            return roundedBytes ? 1.0 - double( requestedBytes ) / double( roundedBytes ) : 0.0;
+        }
+
+        // 0 when all free memory is one block, close to 1 when it is scattered in small blocks
+        inline double externalFragmentation() const noexcept
+        {
+            return freeBytes ? 1.0 - double( largestFreeBlock ) / double( freeBytes ) : 0.0;
+        }
+    };
+}  // namespace buddy
+
+// Buddy allocator over a caller provided region, sized at runtime.
+// The region does not need to be a power of 2, the part of the buddy tree past its end
+// is treated as permanently allocated.
+// Blocks are aligned to their size relative to the region begin.
+// Metadata lives at the start of the region, or in a separate caller provided buffer
+// of at least metadataSize() bytes. The memory policy is only used to purge coalesced blocks.
+template <class THREADING_POLICY, class MEMORY_POLICY = buddy::HeapMemory>
+class RegionBuddyAllocator
+{
+private:
+
+    using LockType = typename THREADING_POLICY::LockType;
+    using ScopedLock = typename THREADING_POLICY::ScopedLock;
+    using LevelLockType = typename THREADING_POLICY::LevelLockType;
+    using LevelScopedLock = typename THREADING_POLICY::LevelScopedLock;
+
+    // keeps each level lock on its own cache line
+    struct alignas( 64 ) Level
+    {
+        LevelLockType lock;
+        // one bit per block of the level, set while the whole block is free
+        buddylib::HierarchicalBitmap freeBlocks;
+        // written under the locks, atomic only so stats() can read it without them
+        std::atomic<std::size_t> freeCount { 0 };
+    };
+
+    // With per level locks a split or merge hides its block from every level between taking
+    // it and marking what is left free, so a search that takes one level lock at a time can
+    // miss free space. Searches that come up empty retry while one of them may be the cause.
+    struct alignas( 64 ) InFlight
+    {
+        std::atomic<std::size_t> running { 0 };
+        std::atomic<std::size_t> finished { 0 };
+    };
+
+    // bounds the retries, so a search on a nearly full arena fails instead of spinning
+    static constexpr std::size_t MAX_SEARCH_RETRIES = 64;
+
+    struct alignas( 64 ) Counters
+    {
+        std::atomic<std::size_t> failedSplits { 0 };
+        std::atomic<std::size_t> requestedBytes { 0 };
+        std::atomic<std::size_t> roundedBytes { 0 };
+    };
+
+private:
+    uint8_t* _memoryPtr;
+    std::size_t _size;
+
+    // size is in power of 2s, _maxSize covers the whole region
+    std::size_t _maxSize;
+    std::size_t _minSize;
+    std::size_t _levelCount;
+
+    // bytes handed to the buddy tree, excluding the metadata and the tail past the region
+    std::size_t _usableBytes;
+
+    Level* _levels;
+
+    // level of each allocated block, stored at the first min block it covers
+    uint8_t* _levelMap;
+
+    LockType _lock;
+
+    InFlight _inFlight;
+
+    Counters _counters;
+private:
+    void init( void* metadata, std::size_t metadataBytes, std::size_t reservedBytes );
+    void freeRange( std::size_t begin, std::size_t end ) noexcept;
+
+    std::size_t takeBlock( std::size_t level ) noexcept;
+    void lockLevels( std::size_t first, std::size_t last ) noexcept;
+    void unlockLevels( std::size_t first, std::size_t last ) noexcept;
+
+    // bracket a split or merge, begin under the lock of the level its block leaves
+    void beginInFlight() noexcept;
+    void endInFlight() noexcept;
+    std::size_t finishedInFlight() const noexcept;
+
+    // true when a search that started at finishedBefore may have missed a hidden block
+    bool mayHaveMissedBlocks( std::size_t finishedBefore ) const noexcept;
+
+    bool growInPlace( std::size_t blockIdx, std::size_t level, std::size_t newLevel ) noexcept;
+    void shrinkInPlace( std::size_t blockIdx, std::size_t level, std::size_t newLevel ) noexcept;
+    void freeNode(std::size_t blockIdx, std::size_t level) noexcept;
+    // the caller already holds _lock
+    void freeNode(std::size_t blockIdx, std::size_t level, ScopedLock&) noexcept;
+
+    void markFree( std::size_t blockIdx, std::size_t level ) noexcept;
+    void markUsed( std::size_t blockIdx, std::size_t level ) noexcept;
+    std::size_t takeFree( std::size_t level ) noexcept;
+
+    void recordAllocation( std::size_t size, std::size_t level, std::size_t count ) noexcept;
+
+    uint8_t* blockAddress( std::size_t blockIdx, std::size_t level ) const noexcept;
+    std::size_t blockIndex( void const* ptr, std::size_t level ) const noexcept;
+
+    std::size_t fixSize(std::size_t allocSize) const noexcept;
+    std::size_t sizeToLevel( std::size_t allocSize ) const noexcept;
+public:
+    static std::size_t metadataSize( std::size_t bytes, std::size_t minBlock ) noexcept;
+
+    // metadata is placed at the start of the region
+    RegionBuddyAllocator( void* base, std::size_t bytes, std::size_t minBlock );
+
+    RegionBuddyAllocator(
+        void* base,
+        std::size_t bytes,
+        std::size_t minBlock,
+        void* metadata,
+        std::size_t metadataBytes );
+
+    RegionBuddyAllocator( RegionBuddyAllocator const& ) = delete;
+    RegionBuddyAllocator& operator=( RegionBuddyAllocator const& ) = delete;
+
+    void* allocate( std::size_t size ) noexcept;
+    void deallocate( void* ptr, std::size_t size ) noexcept;
+    void deallocate( void* ptr ) noexcept;
+
+    // resizes in place when the buddies along the way are free, otherwise moves the data
+    void* reallocate( void* ptr, std::size_t oldSize, std::size_t newSize ) noexcept;
+
+    // allocates up to count blocks of the same size under a single lock, returns how many it got
+    std::size_t allocateBatch( std::size_t size, std::size_t count, void** out ) noexcept;
+
+    // ptrs is sorted in place and used as scratch space while coalescing
+    void deallocateBatch( void** ptrs, std::size_t count, std::size_t size ) noexcept;
+
+    bool owns( void const* ptr ) const noexcept;
+
+    // block size handed out for ptr, which must be allocated
+    std::size_t allocationSize( void const* ptr ) const noexcept;
+
+    inline void const* memoryBegin() const noexcept { return _memoryPtr; }
+
+    inline std::size_t size() const noexcept { return _size; }
+
+    std::vector<std::size_t> freeNodesPerLevel() const noexcept;
+
+    // O(levels), safe to call while other threads allocate
+    buddy::BuddyStats stats() const noexcept;
+
+    ~RegionBuddyAllocator();
+};
+
+#include "RegionBuddyAllocator.hpp"
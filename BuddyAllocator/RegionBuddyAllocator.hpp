@@ -0,0 +1,676 @@
+#pragma once
+
+#include "RegionBuddyAllocator.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+
+namespace buddylib
+{
+    constexpr std::size_t pow2( std::size_t t ) { return std::size_t( 1 ) << t; }
+
+    inline std::size_t nextPow2( std::size_t t )  // from bittwiddling hacks
+    {
+        --t;
+        t |= t >> 1;
+        t |= t >> 2;
+        t |= t >> 4;
+        t |= t >> 8;
+        t |= t >> 16;
+        t |= ( t >> 16 ) >> 16;
+        ++t;
+        return t;
+    }
+
+    inline bool isPow2( std::size_t t ) { return ( t & ( t - 1 ) ) == 0; }
+
+    inline std::size_t roundUp( std::size_t t, std::size_t alignment )
+    {
+        return ( t + alignment - 1 ) & ~( alignment - 1 );
+    }
+
+    // block indexes are relative to the first block of their level
+    inline std::size_t leftChildIdx( std::size_t idx ) { return idx << 1; }
+
+    inline std::size_t rightChildIdx( std::size_t idx ) { return ( idx << 1 ) + 1; }
+
+    inline std::size_t parentIdx( std::size_t childIdx ) { return childIdx >> 1; }
+
+    inline std::size_t buddyIdx( std::size_t idx ) { return idx ^ 1; }
+}  // namespace buddylib
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::metadataSize(
+    std::size_t bytes,
+    std::size_t minBlock ) noexcept
+{
+    assert( buddylib::isPow2( minBlock ) && bytes >= minBlock );
+    const auto maxSize = buddylib::floorLog2( buddylib::nextPow2( bytes ) );
+    const auto levelCount = maxSize - buddylib::floorLog2( minBlock ) + 1;
+
+    std::size_t words = 0;
+    for ( std::size_t level = 0; level < levelCount; ++level )
+        words += buddylib::HierarchicalBitmap::wordsFor( buddylib::pow2( level ) );
+
+    return alignof( Level ) - 1 + levelCount * sizeof( Level ) + words * sizeof( buddylib::Word )
+           + ( bytes + minBlock - 1 ) / minBlock;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::init(
+    void* metadata,
+    std::size_t metadataBytes,
+    std::size_t reservedBytes )
+{
+    assert( _size >= buddylib::pow2( _minSize ) );
+    if ( metadataBytes < metadataSize( _size, buddylib::pow2( _minSize ) ) || _levelCount > 256 )
+        throw std::bad_alloc();
+
+    auto storage = reinterpret_cast<uint8_t*>(
+        buddylib::roundUp( reinterpret_cast<std::uintptr_t>( metadata ), alignof( Level ) ) );
+
+    _levels = reinterpret_cast<Level*>( storage );
+    auto words = reinterpret_cast<buddylib::Word*>( storage + _levelCount * sizeof( Level ) );
+    for ( std::size_t level = 0; level < _levelCount; ++level )
+    {
+        new ( &_levels[level] ) Level();
+        _levels[level].freeBlocks.init( words, buddylib::pow2( level ) );
+        words += buddylib::HierarchicalBitmap::wordsFor( buddylib::pow2( level ) );
+    }
+    _levelMap = reinterpret_cast<uint8_t*>( words );
+
+    const auto minBlock = buddylib::pow2( _minSize );
+    const auto begin = buddylib::roundUp( reservedBytes, minBlock );
+    const auto end = _size & ~( minBlock - 1 );
+    _usableBytes = end - begin;
+    freeRange( begin, end );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::freeRange(
+    std::size_t begin,
+    std::size_t end ) noexcept
+{
+    // cover the range with the largest blocks aligned to their size,
+    // their buddies stick out of the range so they never coalesce
+    while ( begin < end )
+    {
+        auto sizeLog2 = begin == 0 ? _maxSize
+                                   : std::min( _maxSize, buddylib::countTrailingZeros( begin ) );
+        while ( begin + buddylib::pow2( sizeLog2 ) > end )
+            --sizeLog2;
+
+        markFree( begin >> sizeLog2, _maxSize - sizeLog2 );
+        begin += buddylib::pow2( sizeLog2 );
+    }
+}
+
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::markFree(
+    std::size_t blockIdx,
+    std::size_t level ) noexcept
+{
+    assert( !_levels[level].freeBlocks.test( blockIdx ) );
+    _levels[level].freeBlocks.set( blockIdx );
+    auto& freeCount = _levels[level].freeCount;
+    freeCount.store( freeCount.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::markUsed(
+    std::size_t blockIdx,
+    std::size_t level ) noexcept
+{
+    assert( _levels[level].freeBlocks.test( blockIdx ) );
+    _levels[level].freeBlocks.clear( blockIdx );
+    auto& freeCount = _levels[level].freeCount;
+    freeCount.store( freeCount.load( std::memory_order_relaxed ) - 1, std::memory_order_relaxed );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::takeFree(
+    std::size_t level ) noexcept
+{
+    auto blockIdx = _levels[level].freeBlocks.findFirst();
+    if ( blockIdx != buddylib::npos )
+        markUsed( blockIdx, level );
+    return blockIdx;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::recordAllocation(
+    std::size_t size,
+    std::size_t level,
+    std::size_t count ) noexcept
+{
+    _counters.requestedBytes.fetch_add( size * count, std::memory_order_relaxed );
+    _counters.roundedBytes.fetch_add( count << ( _maxSize - level ), std::memory_order_relaxed );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline uint8_t* RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::blockAddress(
+    std::size_t blockIdx,
+    std::size_t level ) const noexcept
+{
+    return _memoryPtr + ( blockIdx << ( _maxSize - level ) );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::blockIndex(
+    void const* ptr,
+    std::size_t level ) const noexcept
+{
+    auto offset = static_cast<std::size_t>( static_cast<uint8_t const*>( ptr ) - _memoryPtr );
+    return offset >> ( _maxSize - level );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::takeBlock(
+    std::size_t level ) noexcept
+{
+    auto beginSplitLvl = level;
+    auto blockIdx = buddylib::npos;
+    for ( std::size_t retries = 0;; ++retries )
+    {
+        const auto finished = finishedInFlight();
+        for ( beginSplitLvl = level;; --beginSplitLvl )
+        {
+            LevelScopedLock guard { _levels[beginSplitLvl].lock };
+            blockIdx = takeFree( beginSplitLvl );
+            if ( blockIdx != buddylib::npos )
+            {
+                if ( beginSplitLvl < level )
+                    beginInFlight();
+                break;
+            }
+            if ( beginSplitLvl == 0 )
+                break;
+        }
+
+        if ( blockIdx != buddylib::npos )
+            break;
+        // steady split and merge traffic could keep the searches above failing forever
+        if ( !mayHaveMissedBlocks( finished ) || retries == MAX_SEARCH_RETRIES )
+            return buddylib::npos;
+        std::this_thread::yield();
+    }
+
+    // keep splitting the left half, the right halves become free blocks of the lower levels
+    for ( std::size_t currentLvl = beginSplitLvl + 1; currentLvl <= level; ++currentLvl )
+    {
+        {
+            LevelScopedLock guard { _levels[currentLvl].lock };
+            markFree( buddylib::rightChildIdx( blockIdx ), currentLvl );
+        }
+        blockIdx = buddylib::leftChildIdx( blockIdx );
+    }
+
+    if ( beginSplitLvl < level )
+        endInFlight();
+    return blockIdx;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::beginInFlight() noexcept
+{
+    if constexpr ( THREADING_POLICY::PER_LEVEL_LOCKS )
+        _inFlight.running.fetch_add( 1 );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::endInFlight() noexcept
+{
+    // finished moves first, so a search that sees nothing running also sees it moved
+    if constexpr ( THREADING_POLICY::PER_LEVEL_LOCKS )
+    {
+        _inFlight.finished.fetch_add( 1 );
+        _inFlight.running.fetch_sub( 1 );
+    }
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::finishedInFlight()
+    const noexcept
+{
+    if constexpr ( THREADING_POLICY::PER_LEVEL_LOCKS )
+        return _inFlight.finished.load();
+    else
+        return 0;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline bool RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::mayHaveMissedBlocks(
+    std::size_t finishedBefore ) const noexcept
+{
+    if constexpr ( THREADING_POLICY::PER_LEVEL_LOCKS )
+        return _inFlight.running.load() != 0 || _inFlight.finished.load() != finishedBefore;
+    else
+        return false;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::lockLevels(
+    std::size_t first,
+    std::size_t last ) noexcept
+{
+    // levels are always locked top down, so this can't deadlock with other multi level locks
+    for ( auto level = first; level <= last; ++level )
+        _levels[level].lock.lock();
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::unlockLevels(
+    std::size_t first,
+    std::size_t last ) noexcept
+{
+    for ( auto level = last + 1; level-- > first; )
+        _levels[level].lock.unlock();
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline bool RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::growInPlace(
+    std::size_t blockIdx,
+    std::size_t level,
+    std::size_t newLevel ) noexcept
+{
+    const auto levelDiff = level - newLevel;
+    if ( blockIdx & ( buddylib::pow2( levelDiff ) - 1 ) )
+        return false;  // block is not the left most descendant of the grown block
+
+    lockLevels( newLevel + 1, level );
+
+    // the buddy of each ancestor up to the grown block must be free as a whole
+    bool buddiesFree = true;
+    for ( auto currentLvl = newLevel + 1; currentLvl <= level && buddiesFree; ++currentLvl )
+    {
+        auto buddyIdx = buddylib::buddyIdx( blockIdx >> ( level - currentLvl ) );
+        buddiesFree = _levels[currentLvl].freeBlocks.test( buddyIdx );
+    }
+
+    if ( buddiesFree )
+        for ( auto currentLvl = newLevel + 1; currentLvl <= level; ++currentLvl )
+            markUsed( buddylib::buddyIdx( blockIdx >> ( level - currentLvl ) ), currentLvl );
+
+    unlockLevels( newLevel + 1, level );
+
+    return buddiesFree;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::shrinkInPlace(
+    std::size_t blockIdx,
+    std::size_t level,
+    std::size_t newLevel ) noexcept
+{
+    ScopedLock guard { _lock };
+
+    // keep the left half, the right halves can't coalesce since their buddy stays allocated
+    for ( auto currentLvl = level + 1; currentLvl <= newLevel; ++currentLvl )
+    {
+        freeNode( buddylib::rightChildIdx( blockIdx ), currentLvl, guard );
+        blockIdx = buddylib::leftChildIdx( blockIdx );
+    }
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::freeNode(
+    std::size_t blockIdx,
+    std::size_t level ) noexcept
+{
+    ScopedLock guard { _lock };
+
+    freeNode( blockIdx, level, guard );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::freeNode(
+    std::size_t blockIdx,
+    std::size_t level,
+    ScopedLock& ) noexcept
+{
+    bool merging = false;
+    for ( ;; --level )
+    {
+        LevelScopedLock guard { _levels[level].lock };
+
+        auto buddyIdx = buddylib::buddyIdx( blockIdx );
+        if ( level == 0 || !_levels[level].freeBlocks.test( buddyIdx ) )
+        {
+            // purge while the block is still invisible to other threads
+            if ( _maxSize - level >= MEMORY_POLICY::PURGE_SIZE )
+                MEMORY_POLICY::purge(
+                    blockAddress( blockIdx, level ), buddylib::pow2( _maxSize - level ) );
+            markFree( blockIdx, level );
+            if ( merging )
+                endInFlight();
+            return;
+        }
+
+        // the buddy is hidden until the merged block is marked free on a higher level
+        if ( !merging )
+            beginInFlight();
+        merging = true;
+        markUsed( buddyIdx, level );
+        blockIdx = buddylib::parentIdx( blockIdx );
+    }
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::fixSize(
+    std::size_t allocSize ) const noexcept
+{
+    if ( !buddylib::isPow2( allocSize ) )
+        allocSize = buddylib::nextPow2( allocSize );
+    return std::max( allocSize, buddylib::pow2( _minSize ) );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::sizeToLevel(
+    std::size_t allocSize ) const noexcept
+{
+    return _maxSize - buddylib::floorLog2( fixSize( allocSize ) );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void* RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::allocate(
+    std::size_t size ) noexcept
+{
+    if ( size > buddylib::pow2( _maxSize ) )
+        return nullptr;
+
+    auto level = sizeToLevel( size );
+    ScopedLock guard { _lock };
+    auto blockIdx = takeBlock( level );
+    if ( blockIdx == buddylib::npos )
+    {
+        _counters.failedSplits.fetch_add( 1, std::memory_order_relaxed );
+        return nullptr;
+    }
+
+    auto ptr = blockAddress( blockIdx, level );
+    if ( !MEMORY_POLICY::commit( ptr, buddylib::pow2( _maxSize - level ) ) )
+    {
+        freeNode( blockIdx, level, guard );
+        return nullptr;
+    }
+
+    _levelMap[( ptr - _memoryPtr ) >> _minSize] = static_cast<uint8_t>( level );
+    recordAllocation( size, level, 1 );
+    return ptr;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::deallocate(
+    void* ptr,
+    std::size_t size ) noexcept
+{
+    auto level = sizeToLevel( size );
+    assert( _levelMap[( static_cast<uint8_t*>( ptr ) - _memoryPtr ) >> _minSize] == level );
+
+    freeNode( blockIndex( ptr, level ), level );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::deallocate(
+    void* ptr ) noexcept
+{
+    assert( owns( ptr ) );
+    std::size_t level = _levelMap[( static_cast<uint8_t*>( ptr ) - _memoryPtr ) >> _minSize];
+
+    freeNode( blockIndex( ptr, level ), level );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void* RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::reallocate(
+    void* ptr,
+    std::size_t oldSize,
+    std::size_t newSize ) noexcept
+{
+    if ( !ptr )
+        return allocate( newSize );
+
+    if ( newSize > buddylib::pow2( _maxSize ) )
+        return nullptr;
+
+    const auto level = sizeToLevel( oldSize );
+    const auto newLevel = sizeToLevel( newSize );
+    assert( _levelMap[( static_cast<uint8_t*>( ptr ) - _memoryPtr ) >> _minSize] == level );
+    if ( newLevel == level )
+        return ptr;
+
+    const auto blockIdx = blockIndex( ptr, level );
+    if ( newLevel > level )
+    {
+        shrinkInPlace( blockIdx, level, newLevel );
+    }
+    else
+    {
+        bool grown = false;
+        {
+            ScopedLock guard { _lock };
+            grown = growInPlace( blockIdx, level, newLevel );
+        }
+
+        if ( grown && !MEMORY_POLICY::commit( ptr, buddylib::pow2( _maxSize - newLevel ) ) )
+        {
+            shrinkInPlace( blockIdx >> ( level - newLevel ), newLevel, level );
+            return nullptr;
+        }
+
+        if ( !grown )
+        {
+            auto newPtr = allocate( newSize );
+            if ( !newPtr )
+                return nullptr;
+
+            std::memcpy( newPtr, ptr, std::min( oldSize, newSize ) );
+            deallocate( ptr, oldSize );
+            return newPtr;
+        }
+    }
+
+    _levelMap[( static_cast<uint8_t*>( ptr ) - _memoryPtr ) >> _minSize] =
+        static_cast<uint8_t>( newLevel );
+    recordAllocation( newSize, newLevel, 1 );
+    return ptr;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::allocateBatch(
+    std::size_t size,
+    std::size_t count,
+    void** out ) noexcept
+{
+    if ( size > buddylib::pow2( _maxSize ) )
+        return 0;
+
+    const auto level = sizeToLevel( size );
+    std::size_t allocated = 0;
+
+    ScopedLock guard { _lock };
+    lockLevels( 0, level );
+
+    // blocks move between levels, searches that already passed some of them retry
+    beginInFlight();
+    while ( allocated < count )
+    {
+        auto splitLvl = level;
+        auto blockIdx = takeFree( splitLvl );
+        while ( blockIdx == buddylib::npos && splitLvl > 0 )
+            blockIdx = takeFree( --splitLvl );
+        if ( blockIdx == buddylib::npos )
+        {
+            _counters.failedSplits.fetch_add( 1, std::memory_order_relaxed );
+            break;
+        }
+
+        // hand out the whole subtree at once, what is left over goes back as the largest blocks
+        const auto subtreeLog2 = level - splitLvl;
+        const auto firstIdx = blockIdx << subtreeLog2;
+        const auto taken = std::min( buddylib::pow2( subtreeLog2 ), count - allocated );
+        const auto blockSizeLog2 = _maxSize - level;
+        if ( !MEMORY_POLICY::commit( blockAddress( firstIdx, level ), taken << blockSizeLog2 ) )
+        {
+            markFree( blockIdx, splitLvl );  // back where it was taken, its buddy is still used
+            break;
+        }
+
+        for ( auto idx = firstIdx; idx < firstIdx + taken; ++idx )
+        {
+            auto ptr = blockAddress( idx, level );
+            _levelMap[( ptr - _memoryPtr ) >> _minSize] = static_cast<uint8_t>( level );
+            out[allocated++] = ptr;
+        }
+
+        freeRange(
+            ( firstIdx + taken ) << blockSizeLog2,
+            ( firstIdx + buddylib::pow2( subtreeLog2 ) ) << blockSizeLog2 );
+    }
+    endInFlight();
+    unlockLevels( 0, level );
+
+    recordAllocation( size, level, allocated );
+    return allocated;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline void RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::deallocateBatch(
+    void** ptrs,
+    std::size_t count,
+    std::size_t size ) noexcept
+{
+    const auto level = sizeToLevel( size );
+    std::sort( ptrs, ptrs + count );
+
+    ScopedLock guard { _lock };
+    lockLevels( 0, level );
+    beginInFlight();
+
+    // coalesce bottom up one level at a time, the merged blocks are compacted to the front of ptrs
+    for ( auto currentLvl = level;; --currentLvl )
+    {
+        std::size_t merged = 0;
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            const auto blockIdx = blockIndex( ptrs[i], currentLvl );
+            const auto buddyIdx = buddylib::buddyIdx( blockIdx );
+            const bool isLeft = ( blockIdx & 1 ) == 0;
+            if ( currentLvl > 0 && isLeft && i + 1 < count
+                 && ptrs[i + 1] == blockAddress( buddyIdx, currentLvl ) )
+            {
+                ptrs[merged++] = ptrs[i++];  // both buddies are part of the batch
+            }
+            else if ( currentLvl > 0 && _levels[currentLvl].freeBlocks.test( buddyIdx ) )
+            {
+                markUsed( buddyIdx, currentLvl );
+                ptrs[merged++] = blockAddress( buddylib::parentIdx( blockIdx ), currentLvl - 1 );
+            }
+            else
+            {
+                if ( _maxSize - currentLvl >= MEMORY_POLICY::PURGE_SIZE )
+                    MEMORY_POLICY::purge( ptrs[i], buddylib::pow2( _maxSize - currentLvl ) );
+                markFree( blockIdx, currentLvl );
+            }
+        }
+
+        if ( merged == 0 )
+            break;
+        count = merged;
+    }
+    endInFlight();
+    unlockLevels( 0, level );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline bool RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::owns(
+    void const* ptr ) const noexcept
+{
+    auto bytePtr = static_cast<uint8_t const*>( ptr );
+    return bytePtr >= _memoryPtr && bytePtr < _memoryPtr + _size;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::size_t RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::allocationSize(
+    void const* ptr ) const noexcept
+{
+    assert( owns( ptr ) );
+    std::size_t level = _levelMap[( static_cast<uint8_t const*>( ptr ) - _memoryPtr ) >> _minSize];
+    return buddylib::pow2( _maxSize - level );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline std::vector<std::size_t>
+RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::freeNodesPerLevel() const noexcept
+{
+    std::vector<std::size_t> result;
+    for ( std::size_t level = 0; level < _levelCount; ++level )
+        result.emplace_back( _levels[level].freeCount.load( std::memory_order_relaxed ) );
+    return result;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline buddy::BuddyStats
+RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::stats() const noexcept
+{
+    buddy::BuddyStats result;
+    result.levelCount = _levelCount;
+    for ( std::size_t level = 0; level < _levelCount; ++level )
+    {
+        const auto freeCount = _levels[level].freeCount.load( std::memory_order_relaxed );
+        const auto bytes = freeCount << ( _maxSize - level );
+        result.freeBytesPerLevel[level] = bytes;
+        result.freeBytes += bytes;
+        if ( freeCount && !result.largestFreeBlock )
+            result.largestFreeBlock = buddylib::pow2( _maxSize - level );
+    }
+
+    // the levels are not read at once, a split in flight can count a block twice
+    result.liveBytes = result.freeBytes < _usableBytes ? _usableBytes - result.freeBytes : 0;
+    result.failedSplits = _counters.failedSplits.load( std::memory_order_relaxed );
+    result.requestedBytes = _counters.requestedBytes.load( std::memory_order_relaxed );
+    result.roundedBytes = _counters.roundedBytes.load( std::memory_order_relaxed );
+    return result;
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::RegionBuddyAllocator(
+    void* base,
+    std::size_t bytes,
+    std::size_t minBlock )
+    : _memoryPtr( static_cast<uint8_t*>( base ) )
+    , _size( bytes )
+    , _maxSize( buddylib::floorLog2( buddylib::nextPow2( bytes ) ) )
+    , _minSize( buddylib::floorLog2( minBlock ) )
+    , _levelCount( _maxSize - _minSize + 1 )
+{
+    const auto metadataBytes = metadataSize( bytes, minBlock );
+    if ( metadataBytes >= bytes )
+        throw std::bad_alloc();
+
+    init( base, metadataBytes, metadataBytes );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::RegionBuddyAllocator(
+    void* base,
+    std::size_t bytes,
+    std::size_t minBlock,
+    void* metadata,
+    std::size_t metadataBytes )
+    : _memoryPtr( static_cast<uint8_t*>( base ) )
+    , _size( bytes )
+    , _maxSize( buddylib::floorLog2( buddylib::nextPow2( bytes ) ) )
+    , _minSize( buddylib::floorLog2( minBlock ) )
+    , _levelCount( _maxSize - _minSize + 1 )
+{
+    init( metadata, metadataBytes, 0 );
+}
+
+template <class THREADING_POLICY, class MEMORY_POLICY>
+inline RegionBuddyAllocator<THREADING_POLICY, MEMORY_POLICY>::~RegionBuddyAllocator()
+{
+    for ( std::size_t level = 0; level < _levelCount; ++level )
+        _levels[level].~Level();
+}
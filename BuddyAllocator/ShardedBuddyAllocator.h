@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BuddyAllocator.h"
+#include "ThreadCaches.h"
+#include "ThreadingPolicies.h"
+
+// Front end over several independent buddy arenas.
+// Each thread prefers one arena (assigned round-robin) and falls back to the others
+// when it is exhausted, frees go back to the arena owning the address.
+template <
+    std::size_t MAX_SIZE,
+    std::size_t MIN_SIZE,
+    class THREADING_POLICY = buddy::MultiThreaded,
+    class MEMORY_POLICY = buddy::HeapMemory>
+class ShardedBuddyAllocator
+{
+public:
+    using Arena = BuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>;
+
+private:
+    std::unique_ptr<Arena[]> _arenas;
+    std::size_t _arenaCount;
+
+    // arena begin addresses in ascending order, used to find the owner of a pointer
+    std::vector<std::pair<std::uintptr_t, Arena*>> _ranges;
+
+private:
+    Arena* findArena( void const* ptr ) const noexcept;
+
+public:
+    explicit ShardedBuddyAllocator(
+        std::size_t arenaCount = std::max( 1u, std::thread::hardware_concurrency() ) );
+
+    ShardedBuddyAllocator( ShardedBuddyAllocator const& ) = delete;
+    ShardedBuddyAllocator& operator=( ShardedBuddyAllocator const& ) = delete;
+
+    void* allocate( std::size_t size ) noexcept;
+    void deallocate( void* ptr, std::size_t size ) noexcept;
+    void deallocate( void* ptr ) noexcept;
+
+    bool owns( void const* ptr ) const noexcept;
+
+    inline std::size_t arenaCount() const noexcept { return _arenaCount; }
+
+    inline Arena& arena( std::size_t idx ) noexcept { return _arenas[idx]; }
+};
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline typename ShardedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::Arena*
+ShardedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::findArena(
+    void const* ptr ) const noexcept
+{
+    const auto address = reinterpret_cast<std::uintptr_t>( ptr );
+    auto it = std::upper_bound(
+        std::begin( _ranges ),
+        std::end( _ranges ),
+        address,
+        []( std::uintptr_t value, auto const& range ) { return value < range.first; } );
+
+    if ( it == std::begin( _ranges ) )
+        return nullptr;
+
+    auto arena = std::prev( it )->second;
+    return arena->owns( ptr ) ? arena : nullptr;
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline ShardedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::
+    ShardedBuddyAllocator( std::size_t arenaCount )
+    : _arenas( new Arena[arenaCount] )
+    , _arenaCount( arenaCount )
+{
+    assert( arenaCount > 0 );
+    _ranges.reserve( arenaCount );
+    for ( std::size_t i = 0; i < arenaCount; ++i )
+    {
+        auto begin = reinterpret_cast<std::uintptr_t>( _arenas[i].memoryBegin() );
+        _ranges.emplace_back( begin, &_arenas[i] );
+    }
+    std::sort( std::begin( _ranges ), std::end( _ranges ) );
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline void* ShardedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::allocate(
+    std::size_t size ) noexcept
+{
+    const auto preferred = buddylib::threadSlot() % _arenaCount;
+    for ( std::size_t i = 0; i < _arenaCount; ++i )
+    {
+        auto idx = preferred + i;
+        if ( idx >= _arenaCount )
+            idx -= _arenaCount;
+
+        if ( auto ptr = _arenas[idx].allocate( size ) )
+            return ptr;
+    }
+    return nullptr;
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline void ShardedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::deallocate(
+    void* ptr,
+    std::size_t size ) noexcept
+{
+    auto arena = findArena( ptr );
+    assert( arena );
+    arena->deallocate( ptr, size );
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline void ShardedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::deallocate(
+    void* ptr ) noexcept
+{
+    auto arena = findArena( ptr );
+    assert( arena );
+    arena->deallocate( ptr );
+}
+
+template <std::size_t MAX_SIZE, std::size_t MIN_SIZE, class THREADING_POLICY, class MEMORY_POLICY>
+inline bool ShardedBuddyAllocator<MAX_SIZE, MIN_SIZE, THREADING_POLICY, MEMORY_POLICY>::owns(
+    void const* ptr ) const noexcept
+{
+    return findArena( ptr ) != nullptr;
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace buddylib
+{
+    // round-robin slot of the calling thread, fixed for its lifetime and the same for every
+    // allocator that shards per thread
+    inline std::size_t threadSlot() noexcept
+    {
+        static std::atomic<std::size_t> nextSlot { 0 };
+        thread_local std::size_t slot = nextSlot.fetch_add( 1, std::memory_order_relaxed );
+        return slot;
+    }
+
+    // One CACHE per thread and OWNER, such as the free blocks a thread keeps in front of a
+    // shared allocator. A thread's caches go back through OWNER::flush( CACHE& ) when it exits,
+    // possibly while other threads use the owner, so flush has to be thread safe and noexcept.
+    // An owner that goes away first calls detachThreads(), the caches other threads still hold
+    // are then dropped without a flush.
+    template <class OWNER, class CACHE>
+    class ThreadCacheRegistry
+    {
+    private:
+        struct Entry
+        {
+            // never reused, so the owning thread can match it without synchronization
+            std::uint64_t registryId;
+
+            // cleared under mutex() when the registry goes away first
+            ThreadCacheRegistry* registry;
+
+            CACHE cache;
+        };
+
+        // owns the entries of one thread and flushes them on thread exit
+        struct ThreadEntries
+        {
+            std::vector<std::unique_ptr<Entry>> entries;
+
+            ~ThreadEntries();
+        };
+
+        OWNER& _owner;
+
+        const std::uint64_t _id;
+
+        // entries of all threads using this registry, guarded by mutex()
+        std::vector<Entry*> _entries;
+
+    private:
+        static std::mutex& mutex() noexcept
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static ThreadEntries& threadEntries() noexcept
+        {
+            thread_local ThreadEntries entries;
+            return entries;
+        }
+
+        // entry used by the last call on this thread, skips the lookup in threadEntries()
+        static Entry*& lastEntry() noexcept
+        {
+            thread_local Entry* entry = nullptr;
+            return entry;
+        }
+
+        static std::uint64_t nextId() noexcept
+        {
+            static std::atomic<std::uint64_t> id { 0 };
+            return id.fetch_add( 1, std::memory_order_relaxed ) + 1;
+        }
+
+        // hands the cache of an exiting thread back, the caller holds mutex()
+        void release( Entry& entry ) noexcept;
+
+    public:
+        explicit ThreadCacheRegistry( OWNER& owner ) noexcept
+            : _owner( owner )
+            , _id( nextId() )
+        {
+        }
+
+        ThreadCacheRegistry( ThreadCacheRegistry const& ) = delete;
+        ThreadCacheRegistry& operator=( ThreadCacheRegistry const& ) = delete;
+
+        ~ThreadCacheRegistry() { detachThreads(); }
+
+        // the calling thread's cache, init( CACHE& ) prepares it on first use,
+        // nullptr when it could not be created
+        template <class INIT>
+        CACHE* local( INIT&& init ) noexcept;
+
+        inline CACHE* local() noexcept
+        {
+            return local( []( CACHE& ) {} );
+        }
+
+        // forgets the caches of all threads, call it before the owner loses what they hold
+        void detachThreads() noexcept;
+    };
+
+    template <class OWNER, class CACHE>
+    inline ThreadCacheRegistry<OWNER, CACHE>::ThreadEntries::~ThreadEntries()
+    {
+        std::lock_guard<std::mutex> guard { mutex() };
+        for ( auto& entry : entries )
+        {
+            if ( entry->registry )
+                entry->registry->release( *entry );
+        }
+        lastEntry() = nullptr;
+    }
+
+    template <class OWNER, class CACHE>
+    inline void ThreadCacheRegistry<OWNER, CACHE>::release( Entry& entry ) noexcept
+    {
+        _owner.flush( entry.cache );
+        _entries.erase( std::find( std::begin( _entries ), std::end( _entries ), &entry ) );
+    }
+
+    template <class OWNER, class CACHE>
+    template <class INIT>
+    inline CACHE* ThreadCacheRegistry<OWNER, CACHE>::local( INIT&& init ) noexcept
+    {
+        auto& last = lastEntry();
+        if ( last && last->registryId == _id )
+            return &last->cache;
+
+        auto& local = threadEntries();
+        for ( auto& entry : local.entries )
+        {
+            if ( entry->registryId == _id )
+            {
+                last = entry.get();
+                return &last->cache;
+            }
+        }
+
+        try
+        {
+            std::lock_guard<std::mutex> guard { mutex() };
+
+            // drop the entries of registries that are gone
+            last = nullptr;
+            local.entries.erase(
+                std::remove_if(
+                    std::begin( local.entries ),
+                    std::end( local.entries ),
+                    []( auto const& entry ) { return !entry->registry; } ),
+                std::end( local.entries ) );
+
+            auto entry = std::make_unique<Entry>();
+            entry->registryId = _id;
+            entry->registry = this;
+            init( entry->cache );
+
+            local.entries.reserve( local.entries.size() + 1 );
+            _entries.push_back( entry.get() );
+            local.entries.push_back( std::move( entry ) );
+        }
+        catch ( std::bad_alloc const& )
+        {
+            return nullptr;
+        }
+
+        last = local.entries.back().get();
+        return &last->cache;
+    }
+
+    template <class OWNER, class CACHE>
+    inline void ThreadCacheRegistry<OWNER, CACHE>::detachThreads() noexcept
+    {
+        std::lock_guard<std::mutex> guard { mutex() };
+        for ( auto entry : _entries )
+            entry->registry = nullptr;
+        _entries.clear();
+    }
+}  // namespace buddylib
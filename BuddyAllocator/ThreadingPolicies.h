@@ -4,6 +4,8 @@
 
 namespace buddy
 {
+    // LockType guards a whole allocate/deallocate call,
+    // LevelLockType guards the free blocks of a single level
     struct SingleThreaded
     {
         struct Empty
@@ -18,11 +20,31 @@ namespace buddy
         };
         using LockType = Empty;
         using ScopedLock = LockGuard<LockType>;
+        using LevelLockType = Empty;
+        using LevelScopedLock = LockGuard<LevelLockType>;
+
+        static constexpr bool PER_LEVEL_LOCKS = false;
     };
 
     struct MultiThreaded
     {
         using LockType = std::mutex;
         using ScopedLock = std::lock_guard<LockType>;
+        using LevelLockType = SingleThreaded::Empty;
+        using LevelScopedLock = SingleThreaded::LockGuard<LevelLockType>;
+
+        static constexpr bool PER_LEVEL_LOCKS = false;
+    };
+
+    // one mutex per level, splits and merges on different levels run in parallel
+    // an allocation that keeps racing them gives up after a bounded number of retries
+    struct PerLevelLocked
+    {
+        using LockType = SingleThreaded::Empty;
+        using ScopedLock = SingleThreaded::LockGuard<LockType>;
+        using LevelLockType = std::mutex;
+        using LevelScopedLock = std::lock_guard<LevelLockType>;
+
+        static constexpr bool PER_LEVEL_LOCKS = true;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace allocators
+{
+    // Bump allocator shared by many threads over one fixed size buffer.
+    // Each thread claims SUB_BLOCK_SIZE bytes at a time with a single fetch_add
+    // and bumps through them without atomics. Nothing is freed before reset(),
+    // which must not run concurrently with allocate().
+    // Each thread caches the sub-block of the last arena it used, so a thread alternating
+    // between arenas claims a new sub-block on every switch.
+    template <std::size_t SUB_BLOCK_SIZE = 1 << 16>
+    class ConcurrentLinearAllocator
+    {
+        static_assert(
+            ( SUB_BLOCK_SIZE & ( SUB_BLOCK_SIZE - 1 ) ) == 0,
+            "SUB_BLOCK_SIZE must be a power of 2" );
+
+        struct Cursor
+        {
+            std::uint64_t generation = 0;
+            std::uintptr_t ptr = 0;
+            std::uintptr_t end = 0;
+        };
+
+        char* _memory;
+        std::size_t _capacity;
+
+        std::atomic<std::size_t> _offset;
+
+        // unique across all arenas and resets, a thread's cursor is only valid for its generation
+        std::atomic<std::uint64_t> _generation;
+
+    private:
+        static std::uint64_t nextGeneration() noexcept
+        {
+            static std::atomic<std::uint64_t> generation { 0 };
+            return generation.fetch_add( 1, std::memory_order_relaxed ) + 1;
+        }
+
+        static Cursor& threadCursor() noexcept
+        {
+            thread_local Cursor cursor;
+            return cursor;
+        }
+
+        static inline std::uintptr_t alignUp(
+            std::uintptr_t address,
+            std::size_t alignment ) noexcept
+        {
+            return ( address + alignment - 1 ) & ~( alignment - 1 );
+        }
+
+        // claims bytes from the shared buffer, the last claim may come back shorter
+        std::uintptr_t claim( std::size_t bytes, std::uintptr_t& end )
+        {
+            if ( bytes > _capacity )
+                throw std::bad_alloc();
+
+            const auto offset = _offset.fetch_add( bytes, std::memory_order_relaxed );
+            if ( offset >= _capacity )
+                throw std::bad_alloc();
+
+            const auto begin = reinterpret_cast<std::uintptr_t>( _memory ) + offset;
+            end = begin + std::min( bytes, _capacity - offset );
+            return begin;
+        }
+
+        void* allocateSlow( std::size_t size, std::size_t alignment, Cursor& cursor )
+        {
+            // large requests get their own claim and keep the current sub-block
+            const auto bytes = size + alignment - 1;
+            if ( bytes > SUB_BLOCK_SIZE / 2 )
+            {
+                std::uintptr_t end;
+                auto ptr = alignUp( claim( bytes, end ), alignment );
+                if ( ptr + size > end )
+                    throw std::bad_alloc();
+                return reinterpret_cast<void*>( ptr );
+            }
+
+            // the cursor only moves once the claim succeeded, a throwing claim leaves it stale
+            const auto generation = _generation.load( std::memory_order_relaxed );
+            std::uintptr_t end;
+            const auto begin = claim( std::min( SUB_BLOCK_SIZE, _capacity ), end );
+            cursor.generation = generation;
+            cursor.ptr = begin;
+            cursor.end = end;
+
+            auto ptr = alignUp( cursor.ptr, alignment );
+            if ( ptr + size > cursor.end )
+                throw std::bad_alloc();
+            cursor.ptr = ptr + size;
+            return reinterpret_cast<void*>( ptr );
+        }
+
+    public:
+        explicit ConcurrentLinearAllocator( std::size_t capacity )
+            : _memory( static_cast<char*>( std::malloc( capacity ) ) )
+            , _capacity( capacity )
+            , _offset( 0 )
+            , _generation( nextGeneration() )
+        {
+            if ( !_memory )
+                throw std::bad_alloc();
+        }
+
+        ConcurrentLinearAllocator( ConcurrentLinearAllocator const& ) = delete;
+        ConcurrentLinearAllocator& operator=( ConcurrentLinearAllocator const& ) = delete;
+
+        ~ConcurrentLinearAllocator() { std::free( _memory ); }
+
+        inline void* allocate(
+            std::size_t size,
+            std::size_t alignment = alignof( std::max_align_t ) )
+        {
+            assert( alignment && ( alignment & ( alignment - 1 ) ) == 0 );
+            auto& cursor = threadCursor();
+            if ( cursor.generation == _generation.load( std::memory_order_relaxed ) )
+            {
+                const auto ptr = alignUp( cursor.ptr, alignment );
+                if ( ptr <= cursor.end && size <= cursor.end - ptr )
+                {
+                    cursor.ptr = ptr + size;
+                    return reinterpret_cast<void*>( ptr );
+                }
+            }
+            return allocateSlow( size, alignment, cursor );
+        }
+
+        // memory is only given back by reset()
+        inline void deallocate( void*, std::size_t ) noexcept {}
+
+        // frees everything in O(1), the cursors of all threads go stale with the old generation
+        inline void reset() noexcept
+        {
+            _offset.store( 0, std::memory_order_relaxed );
+            _generation.store( nextGeneration(), std::memory_order_relaxed );
+        }
+
+        // bytes claimed so far, including the unused tails of the threads' sub-blocks
+        inline std::size_t claimed() const noexcept
+        {
+            return std::min( _offset.load( std::memory_order_relaxed ), _capacity );
+        }
+
+        inline std::size_t capacity() const noexcept { return _capacity; }
+    };
+}  // namespace allocators
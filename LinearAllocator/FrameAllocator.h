@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include "LinearAllocator.h"
+
+namespace allocators
+{
+    // Rotates between FRAMES linear arenas for pipelined stages.
+    // beginFrame() resets the oldest arena, so memory allocated in a frame
+    // stays valid for the next FRAMES - 1 frames. Objects are never freed one by one.
+    template <std::size_t INITIAL_SIZE, std::size_t FRAMES = 2>
+    class FrameAllocator
+    {
+        static_assert( FRAMES >= 2, "a single frame would be reset while still in use" );
+
+        std::array<LinearAllocator<INITIAL_SIZE>, FRAMES> _arenas;
+        std::size_t _frame;
+
+    public:
+        FrameAllocator()
+            : _frame( 0 )
+        {
+        }
+
+        FrameAllocator( FrameAllocator const& ) = delete;
+        FrameAllocator& operator=( FrameAllocator const& ) = delete;
+
+        // the allocations of the frame that used this slot FRAMES frames ago are freed
+        inline std::size_t beginFrame() noexcept
+        {
+            if ( ++_frame == FRAMES )
+                _frame = 0;
+            _arenas[_frame].reset();
+            return _frame;
+        }
+
+        inline void* allocate(
+            std::size_t size,
+            std::size_t alignment = alignof( std::max_align_t ) )
+        {
+            return _arenas[_frame].allocate( size, alignment );
+        }
+
+        template <class T, class... Args>
+        inline T* make( Args&&... args )
+        {
+            return _arenas[_frame].template make<T>( std::forward<Args>( args )... );
+        }
+
+        // memory is given back when the frame's slot comes around again
+        inline void deallocate( void*, std::size_t ) noexcept {}
+
+        inline std::size_t currentFrame() const noexcept { return _frame; }
+
+        inline LinearAllocator<INITIAL_SIZE>& frameArena( std::size_t frame ) noexcept
+        {
+            return _arenas[frame];
+        }
+    };
+}  // namespace allocators
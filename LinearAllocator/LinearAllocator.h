@@ -1,34 +1,314 @@
-﻿#include <cassert>
-#include <memory>
+﻿#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace allocators
 {
-    template <long long MAX_SIZE>
+    // Bump allocator over a chain of malloc'ed blocks, each new block twice the size of the last.
+    // reset() rewinds to the first block in O(1) and keeps the chain for reuse,
+    // blocks past the retained capacity are released on reset() or trim().
+    // Used as a stack, getMarker()/rewindTo() free everything allocated after the marker,
+    // deallocations must then be LIFO, which debug builds check.
+    // Objects built with make<T>() are destroyed in reverse order on reset() or rewindTo().
+    template <std::size_t INITIAL_SIZE>
     class LinearAllocator
     {
-        char* _memory;
-        long long _offset;
+        static_assert( INITIAL_SIZE > 0, "INITIAL_SIZE must not be 0" );
+
+        struct Block
+        {
+            Block* next;
+            std::size_t size;  // usable bytes after the header
+
+            inline char* begin() noexcept { return reinterpret_cast<char*>( this + 1 ); }
+            inline char* end() noexcept { return begin() + size; }
+        };
+
+        // sits in front of each object that has to be destroyed, newest first
+        struct Destructor
+        {
+            Destructor* next;
+            void ( *destroy )( Destructor* );
+        };
+
+        template <class T>
+        static constexpr std::size_t objectOffset()
+        {
+            return ( sizeof( Destructor ) + alignof( T ) - 1 ) & ~( alignof( T ) - 1 );
+        }
+
+        template <class T>
+        static void destroyObject( Destructor* node )
+        {
+            reinterpret_cast<T*>( reinterpret_cast<char*>( node ) + objectOffset<T>() )->~T();
+        }
+
+        Block* _first;
+        Block* _current;
+        char* _ptr;
+        char* _end;
+
+        Destructor* _destructors;
+
+        std::size_t _capacity;
+        std::size_t _retainedCapacity;
+
+#ifndef NDEBUG
+        // live allocations in allocation order, checks that deallocations are LIFO
+        std::vector<void*> _debugStack;
+#endif
+
+    public:
+        struct Marker
+        {
+            Block* block;
+            char* ptr;
+            Destructor* destructors;
+#ifndef NDEBUG
+            std::size_t depth;
+#endif
+        };
+
+    private:
+        inline void destroyUntil( Destructor* last ) noexcept
+        {
+            while ( _destructors != last )
+            {
+                auto node = _destructors;
+                _destructors = node->next;
+                node->destroy( node );
+            }
+        }
+
+        static inline std::uintptr_t alignUp( char* ptr, std::size_t alignment ) noexcept
+        {
+            return ( reinterpret_cast<std::uintptr_t>( ptr ) + alignment - 1 ) & ~( alignment - 1 );
+        }
+
+        Block* newBlock( std::size_t size )
+        {
+            if ( size > std::numeric_limits<std::size_t>::max() - sizeof( Block ) )
+                throw std::bad_alloc();
+
+            auto block = static_cast<Block*>( std::malloc( sizeof( Block ) + size ) );
+            if ( !block )
+                throw std::bad_alloc();
+
+            block->next = nullptr;
+            block->size = size;
+            _capacity += size;
+            return block;
+        }
+
+        void freeChain( Block* block ) noexcept
+        {
+            while ( block )
+            {
+                auto next = block->next;
+                _capacity -= block->size;
+                std::free( block );
+                block = next;
+            }
+        }
+
+        inline void enter( Block* block ) noexcept
+        {
+            _current = block;
+            _ptr = block->begin();
+            _end = block->end();
+        }
+
+        // null when the request doesn't fit the current block
+        inline char* bump( std::size_t size, std::size_t alignment ) noexcept
+        {
+            const auto address = alignUp( _ptr, alignment );
+            const auto end = reinterpret_cast<std::uintptr_t>( _end );
+            if ( address > end || size > end - address )
+                return nullptr;
+
+            _ptr = reinterpret_cast<char*>( address + size );
+            return reinterpret_cast<char*>( address );
+        }
+
+        void* allocateSlow( std::size_t size, std::size_t alignment )
+        {
+            // reuse the blocks kept by reset() before growing the chain
+            while ( _current->next )
+            {
+                enter( _current->next );
+                if ( auto ptr = bump( size, alignment ) )
+                    return ptr;
+            }
+
+            if ( size > std::numeric_limits<std::size_t>::max() - alignment )
+                throw std::bad_alloc();
+
+            auto block = newBlock( std::max( _current->size * 2, size + alignment - 1 ) );
+            _current->next = block;
+            enter( block );
+            return bump( size, alignment );
+        }
 
     public:
-        LinearAllocator()
+        explicit LinearAllocator( std::size_t retainedCapacity = 4 * INITIAL_SIZE )
+            : _destructors( nullptr )
+            , _capacity( 0 )
+            , _retainedCapacity( retainedCapacity )
+        {
+            _first = newBlock( INITIAL_SIZE );
+            enter( _first );
+        }
+
+        LinearAllocator( LinearAllocator const& ) = delete;
+        LinearAllocator& operator=( LinearAllocator const& ) = delete;
+
+        ~LinearAllocator()
+        {
+            destroyUntil( nullptr );
+            freeChain( _first );
+        }
+
+        inline void* allocate(
+            std::size_t size,
+            std::size_t alignment = alignof( std::max_align_t ) )
+        {
+            assert( alignment && ( alignment & ( alignment - 1 ) ) == 0 );
+            void* ptr = bump( size, alignment );
+            if ( !ptr )
+                ptr = allocateSlow( size, alignment );
+#ifndef NDEBUG
+            _debugStack.push_back( ptr );
+#endif
+            return ptr;
+        }
+
+        // trivially destructible objects cost the same as a plain allocation
+        template <class T, class... Args>
+        T* make( Args&&... args )
+        {
+            if constexpr ( std::is_trivially_destructible_v<T> )
+            {
+                auto ptr = allocate( sizeof( T ), alignof( T ) );
+                return new ( ptr ) T( std::forward<Args>( args )... );
+            }
+            else
+            {
+                constexpr auto alignment = std::max( alignof( Destructor ), alignof( T ) );
+                auto node = static_cast<Destructor*>(
+                    allocate( objectOffset<T>() + sizeof( T ), alignment ) );
+                auto object = new ( reinterpret_cast<char*>( node ) + objectOffset<T>() )
+                    T( std::forward<Args>( args )... );
+
+                // linked only once constructed, a throwing constructor leaves nothing to destroy
+                node->next = _destructors;
+                node->destroy = &destroyObject<T>;
+                _destructors = node;
+                return object;
+            }
+        }
+
+        // deallocations must be LIFO, the memory is reused right away while the allocation
+        // is in the current block, otherwise when the arena is rewound
+        inline void deallocate( void* ptr, std::size_t size ) noexcept
         {
-            _memory = static_cast<char*>( malloc( MAX_SIZE ) );
-            _offset = 0;
+#ifndef NDEBUG
+            assert( !_debugStack.empty() && _debugStack.back() == ptr && "deallocate is not LIFO" );
+            _debugStack.pop_back();
+#endif
+            if ( static_cast<char*>( ptr ) + size == _ptr )
+                _ptr = static_cast<char*>( ptr );
         }
 
-        ~LinearAllocator() { free( _memory ); }
+        inline Marker getMarker() const noexcept
+        {
+#ifndef NDEBUG
+            return { _current, _ptr, _destructors, _debugStack.size() };
+#else
+            return { _current, _ptr, _destructors };
+#endif
+        }
 
-        void* allocate( std::size_t size )
+        // frees everything allocated after the marker, the blocks stay in the chain for reuse.
+        // reset() and trim() invalidate the markers taken before them
+        inline void rewindTo( Marker const& marker ) noexcept
         {
-            assert( MAX_SIZE - _offset > size )
+            destroyUntil( marker.destructors );
+#ifndef NDEBUG
+            assert( marker.depth <= _debugStack.size() );
+            _debugStack.resize( marker.depth );
+#endif
+            if ( marker.block != _current )
+            {
+                _current = marker.block;
+                _end = marker.block->end();
+            }
+            _ptr = marker.ptr;
+        }
 
-                char* address = _memory + _offset;
+        inline void reset() noexcept
+        {
+            destroyUntil( nullptr );
+#ifndef NDEBUG
+            _debugStack.clear();
+#endif
+            enter( _first );
+            if ( _capacity > _retainedCapacity )
+                trim( _retainedCapacity );
+        }
 
-            _offset += size;
+        // releases the blocks after the current one that don't fit in retainedCapacity
+        void trim( std::size_t retainedCapacity = 0 ) noexcept
+        {
+            auto last = _first;
+            auto kept = _first->size;
+            bool pastCurrent = _first == _current;
+            while ( last->next && ( !pastCurrent || kept + last->next->size <= retainedCapacity ) )
+            {
+                last = last->next;
+                kept += last->size;
+                pastCurrent = pastCurrent || last == _current;
+            }
 
-            return address;
+            freeChain( last->next );
+            last->next = nullptr;
         }
 
-        void deallocate( void* ptr, size_t size ) { _offset -= size; }
+        // bytes in all blocks of the chain, headers excluded
+        inline std::size_t capacity() const noexcept { return _capacity; }
+    };
+
+    // rewinds the arena to where it was when the scope was entered
+    template <class Arena>
+    class ScopedArena
+    {
+        Arena& _arena;
+        typename Arena::Marker _marker;
+
+    public:
+        explicit ScopedArena( Arena& arena ) noexcept
+            : _arena( arena )
+            , _marker( arena.getMarker() )
+        {
+        }
+
+        ScopedArena( ScopedArena const& ) = delete;
+        ScopedArena& operator=( ScopedArena const& ) = delete;
+
+        ~ScopedArena() { _arena.rewindTo( _marker ); }
+
+        inline void* allocate(
+            std::size_t size,
+            std::size_t alignment = alignof( std::max_align_t ) )
+        {
+            return _arena.allocate( size, alignment );
+        }
     };
 }  // namespace allocators
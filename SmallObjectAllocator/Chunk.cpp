@@ -1,30 +1,38 @@
-#include <bitset>
+#include <algorithm>
 #include <cassert>
 #include <limits>
+#include <new>
+#include <vector>
 #include "Chunk.h"
+#include "SuperblockPool.h"
 
 namespace allocators
 {
-    template<class AllocationPolicy>
-    Chunk<AllocationPolicy>::Chunk(SizeType blockSize, DataType blocks)
+    template <class IndexType, class AllocationPolicy>
+    Chunk<IndexType, AllocationPolicy>::Chunk(
+        SizeType blockSize,
+        IndexType blocks,
+        SizeType minBytes)
     {
-        assert(blockSize > 0);
+        assert(blockSize >= sizeof(IndexType));
         assert(blocks > 0);
-        const auto sizeToAllocate = blockSize * blocks;
-        assert(sizeToAllocate / blockSize == blocks);
+        const auto blockBytes = blockSize * blocks;
+        assert(blockBytes / blockSize == blocks);
 
-        _dataPtr = AllocationPolicy::alloc(sizeToAllocate);
+        _dataPtr = AllocationPolicy::alloc(std::max(blockBytes, minBytes));
         if (!_dataPtr)
         {
             LOG(
-                "Allocation failed! with params blockSize %zu and numBlocks %d", blockSize, blocks);
+                "Allocation failed! with params blockSize %zu and numBlocks %zu",
+                blockSize,
+                static_cast<SizeType>( blocks ) );
             throw std::bad_alloc();
         }
 
         reset(blockSize, blocks);
     }
-    template <class AllocationPolicy>
-    void* Chunk<AllocationPolicy>::allocate( SizeType blockSize )
+    template <class IndexType, class AllocationPolicy>
+    void* Chunk<IndexType, AllocationPolicy>::allocate( SizeType blockSize )
     {
         if ( isFull() )
         {
@@ -35,19 +43,19 @@ namespace allocators
         auto offset = _firstAvailableBlock * blockSize;
         assert( offset / blockSize == _firstAvailableBlock );
         decltype( _dataPtr ) resultPtr = _dataPtr + offset;
-        _firstAvailableBlock = *resultPtr;
+        _firstAvailableBlock = readIndex( resultPtr );
         --_blocksAvailable;
         return resultPtr;
     }
-    template <class AllocationPolicy>
-    void Chunk<AllocationPolicy>::deallocate( void* p, SizeType blockSize )
+    template <class IndexType, class AllocationPolicy>
+    void Chunk<IndexType, AllocationPolicy>::deallocate( void* p, SizeType blockSize )
     {
         assert( p >= _dataPtr );
         auto releasePtr = static_cast<DataType*>( p );
 
         assert( ( releasePtr - _dataPtr ) % blockSize == 0 );
 
-        auto idx = static_cast<DataType>( ( releasePtr - _dataPtr ) / blockSize );
+        auto idx = static_cast<IndexType>( ( releasePtr - _dataPtr ) / blockSize );
 
         // check if block was already deleted
         if ( _blocksAvailable < 0 )
@@ -55,16 +63,16 @@ namespace allocators
             assert( _firstAvailableBlock != idx );
         }
 
-        *releasePtr = _firstAvailableBlock;
+        writeIndex( releasePtr, _firstAvailableBlock );
         _firstAvailableBlock = idx;
         ++_blocksAvailable;
 
         assert( _firstAvailableBlock == ( releasePtr - _dataPtr ) / blockSize );
     }
-    template <class AllocationPolicy>
-    void Chunk<AllocationPolicy>::reset( SizeType blockSize, DataType blocks )
+    template <class IndexType, class AllocationPolicy>
+    void Chunk<IndexType, AllocationPolicy>::reset( SizeType blockSize, IndexType blocks )
     {
-        assert( blockSize > 0 );
+        assert( blockSize >= sizeof( IndexType ) );
         assert( blocks > 0 );
 
         assert( ( ( blockSize * blocks ) / blockSize ) == blocks );
@@ -73,22 +81,22 @@ namespace allocators
 
         // init each data block to store at its begining the number of the next
         // free data block as per Modern CPP Design
-        DataType i = 0;
+        IndexType i = 0;
         for ( DataType* p = _dataPtr; i != blocks; p += blockSize )
         {
-            *p = ++i;
+            writeIndex( p, ++i );
         }
     }
-    template <class AllocationPolicy>
-    void Chunk<AllocationPolicy>::release()
+    template <class IndexType, class AllocationPolicy>
+    void Chunk<IndexType, AllocationPolicy>::release()
     {
         assert( _dataPtr != nullptr );
         AllocationPolicy::free( _dataPtr );
     }
-    template <class AllocationPolicy>
-    bool Chunk<AllocationPolicy>::isCorrupted(
+    template <class IndexType, class AllocationPolicy>
+    bool Chunk<IndexType, AllocationPolicy>::isCorrupted(
         SizeType blockSize,
-        DataType blocks,
+        IndexType blocks,
         bool checkIndexes ) const
     {
         if ( blocks < _blocksAvailable )
@@ -100,7 +108,7 @@ namespace allocators
         if ( isFull() )
             return false;
 
-        DataType index = _firstAvailableBlock;
+        IndexType index = _firstAvailableBlock;
 
         if ( blocks <= index )
         {
@@ -111,33 +119,35 @@ namespace allocators
         if ( !checkIndexes )
             return false;
 
-        std::bitset<std::numeric_limits<DataType>::max()> found;
+        std::vector<bool> found( blocks );
+        SizeType foundCount = 0;
 
         DataType* next;
 
-        for ( DataType i = 0;; )
+        for ( IndexType i = 0;; )
         {
             next = _dataPtr + ( index * blockSize );
-            found.set( index, true );
+            found[index] = true;
+            ++foundCount;
             ++i;
             if ( i >= _blocksAvailable )
                 break;  // success
 
-            index = *next;
+            index = readIndex( next );
             if ( blocks <= index )
             {  // block index bigger than block count
                 assert( false );
                 return true;
             }
 
-            if ( found.test( index ) )
+            if ( found[index] )
             {  // repeated index, loop in linked list
                 assert( false );
                 return true;
             }
         }
 
-        if ( found.count() != _blocksAvailable )
+        if ( foundCount != _blocksAvailable )
         {
             // maybe we called free twice on the same block
             // and the loop didn't catch it
@@ -147,8 +157,11 @@ namespace allocators
 
         return false;
     }
-    template <class AllocationPolicy>
-    bool Chunk<AllocationPolicy>::isBlockAvailable( void* ptr, SizeType blockSize, DataType blocks)
+    template <class IndexType, class AllocationPolicy>
+    bool Chunk<IndexType, AllocationPolicy>::isBlockAvailable(
+        void* ptr,
+        SizeType blockSize,
+        IndexType blocks )
     {
         if ( isFull() )
             return false;
@@ -156,7 +169,7 @@ namespace allocators
         DataType* location = static_cast<DataType*>( ptr );
         auto offset = location - _dataPtr;
         assert( offset % blockSize == 0 );
-        auto blockIdx = static_cast<DataType>( offset / blockSize );
+        auto blockIdx = static_cast<IndexType>( offset / blockSize );
 
         auto index = _firstAvailableBlock;
         assert( blocks > index );
@@ -164,21 +177,21 @@ namespace allocators
         if ( index == blockIdx )
             return true;
 
-        std::bitset<std::numeric_limits<DataType>::max()> found;
+        std::vector<bool> found( blocks );
         DataType* next = nullptr;
-        for ( DataType i = 0;; )
+        for ( IndexType i = 0;; )
         {
             next = _dataPtr + ( index * blockSize );
-            found.set( index, true );
+            found[index] = true;
 
             ++i;
             if ( i >= _blocksAvailable )
                 break;
 
-            index = *next;
+            index = readIndex( next );
 
-            assert( blocks > index );        // corruption checks
-            assert( !found.test( index ) );  // loop in linked list
+            assert( blocks > index );    // corruption checks
+            assert( !found[index] );     // loop in linked list
 
             if ( index == blockIdx )
                 return true;
@@ -187,6 +200,16 @@ namespace allocators
         return false;
     }
 
-    template class Chunk<NewAllocationPolicy>;
-    template class Chunk<MallocAllocationPolicy>;
+    template class Chunk<std::uint8_t, NewAllocationPolicy>;
+    template class Chunk<std::uint16_t, NewAllocationPolicy>;
+    template class Chunk<std::uint32_t, NewAllocationPolicy>;
+    template class Chunk<std::uint8_t, MallocAllocationPolicy>;
+    template class Chunk<std::uint16_t, MallocAllocationPolicy>;
+    template class Chunk<std::uint32_t, MallocAllocationPolicy>;
+    template class Chunk<std::uint8_t, AlignedAllocationPolicy>;
+    template class Chunk<std::uint16_t, AlignedAllocationPolicy>;
+    template class Chunk<std::uint32_t, AlignedAllocationPolicy>;
+    template class Chunk<std::uint8_t, SuperblockAllocationPolicy>;
+    template class Chunk<std::uint16_t, SuperblockAllocationPolicy>;
+    template class Chunk<std::uint32_t, SuperblockAllocationPolicy>;
 }  // namespace allocators
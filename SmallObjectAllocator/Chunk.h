@@ -1,43 +1,67 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <new>
 #include "../utils.h"
 
 namespace allocators
 {
     struct NewAllocationPolicy;
     struct MallocAllocationPolicy;
+    struct AlignedAllocationPolicy;
 
     using DataType = std::uint8_t;
     using SizeType = std::size_t;
 
-    template <class AllocationPolicy = NewAllocationPolicy>
+    template <class IndexType, class AllocationPolicy>
+    class FixedAllocator;
+
+    // IndexType limits the number of blocks per chunk, each block must fit one index
+    template <class IndexType = std::uint8_t, class AllocationPolicy = NewAllocationPolicy>
     class Chunk
     {
     public:
         using AllocatorPolicy = AllocationPolicy;
+        using Index = IndexType;
     public:
         Chunk() = default;
-        Chunk(SizeType blockSize, DataType blocks);
+        // backs at least minBytes, which may leave room past the last block
+        Chunk(SizeType blockSize, IndexType blocks, SizeType minBytes = 0);
         Chunk(Chunk const&) = delete;
         Chunk& operator=(Chunk const&) = delete;
         Chunk(Chunk&&) = default;
         Chunk& operator=(Chunk&&) = default;
         ~Chunk() = default;
     private:
-        friend class FixedAllocator;
+        friend class FixedAllocator<IndexType, AllocationPolicy>;
+
+        // free blocks store the index of the next free block, possibly unaligned
+        static inline IndexType readIndex( DataType const* p )
+        {
+            IndexType index;
+            std::memcpy( &index, p, sizeof( IndexType ) );
+            return index;
+        }
+
+        static inline void writeIndex( DataType* p, IndexType index )
+        {
+            std::memcpy( p, &index, sizeof( IndexType ) );
+        }
 
         void* allocate( SizeType blockSize );
 
         void deallocate( void* p, SizeType blockSize );
 
-        void reset( SizeType blockSize, DataType blocks );
+        void reset( SizeType blockSize, IndexType blocks );
 
         void release();
 
-        bool isCorrupted( SizeType blockSize, DataType blocks, bool checkIndexes ) const;
+        bool isCorrupted( SizeType blockSize, IndexType blocks, bool checkIndexes ) const;
 
-        bool isBlockAvailable( void* p, SizeType blockSize, DataType blocks );
+        bool isBlockAvailable( void* p, SizeType blockSize, IndexType blocks );
 
         inline bool hasBlock( void* p, SizeType chunkSize ) const
         {
@@ -49,15 +73,17 @@ namespace allocators
 
         DataType* _dataPtr;
 
-        DataType _firstAvailableBlock;
+        IndexType _firstAvailableBlock;
 
-        DataType _blocksAvailable;
+        IndexType _blocksAvailable;
     };
 
-    using DefaultChunk = Chunk<NewAllocationPolicy>;
+    using DefaultChunk = Chunk<std::uint8_t, NewAllocationPolicy>;
 
     struct NewAllocationPolicy
     {
+        static constexpr bool ALIGNED_CHUNKS = false;
+
         static DataType* alloc( std::size_t s )
         {
             return static_cast<DataType*>( ::operator new( s ) );
@@ -67,10 +93,67 @@ namespace allocators
 
     struct MallocAllocationPolicy
     {
+        static constexpr bool ALIGNED_CHUNKS = false;
+
         static DataType* alloc( std::size_t s )
         {
             return static_cast<DataType*>( ::std::malloc( s ) );
         }
         static void free( DataType* ptr ) { ::std::free( static_cast<void*>( ptr ) ); }
     };
+
+    // Places each chunk at the start of a block aligned to its own size, rounded up to a power
+    // of 2, behind a header pointing back to the chunk. The chunk of any block is then found by
+    // masking the block address, see owner().
+    struct AlignedAllocationPolicy
+    {
+        static constexpr bool ALIGNED_CHUNKS = true;
+
+        struct Header
+        {
+            void* owner;
+            std::size_t bytes;
+        };
+
+        // keeps the blocks as aligned as NewAllocationPolicy does
+        static constexpr std::size_t HEADER_SIZE =
+            ( ( sizeof( Header ) + alignof( std::max_align_t ) - 1 ) /
+              alignof( std::max_align_t ) ) *
+            alignof( std::max_align_t );
+
+        // bytes and alignment of the memory backing s bytes of blocks
+        static std::size_t chunkBytes( std::size_t s )
+        {
+            std::size_t bytes = 1;
+            while ( bytes < s + HEADER_SIZE )
+                bytes <<= 1;
+            return bytes;
+        }
+
+        static DataType* alloc( std::size_t s )
+        {
+            const auto bytes = chunkBytes( s );
+            auto base = static_cast<DataType*>(
+                ::operator new( bytes, std::align_val_t( bytes ), std::nothrow ) );
+            if ( !base )
+                return nullptr;
+
+            new ( base ) Header { nullptr, bytes };
+            return base + HEADER_SIZE;
+        }
+
+        static void free( DataType* ptr )
+        {
+            auto base = ptr - HEADER_SIZE;
+            const auto bytes = reinterpret_cast<Header*>( base )->bytes;
+            ::operator delete( base, std::align_val_t( bytes ) );
+        }
+
+        // chunk pointer slot of the chunk holding p, chunkBytes as returned by chunkBytes()
+        static inline void*& owner( void const* p, std::size_t chunkBytes )
+        {
+            const auto base = reinterpret_cast<std::uintptr_t>( p ) & ~( chunkBytes - 1 );
+            return reinterpret_cast<Header*>( base )->owner;
+        }
+    };
 }  // namespace allocators
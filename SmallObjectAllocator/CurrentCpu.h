@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "../BuddyAllocator/ThreadCaches.h"
+
+#if defined( __linux__ )
+#include <sched.h>
+#if __has_include( <sys/rseq.h> )
+#include <sys/rseq.h>
+#define ALLOCATORS_HAS_RSEQ 1
+#endif
+#endif
+
+namespace allocators
+{
+    // CPU the calling thread runs on. It may be stale by the time the caller uses it, so it
+    // is only good for picking a shard that is likely uncontended.
+    // Reads the rseq area glibc registers for every thread, without a system call.
+    // Falls back to sched_getcpu(), and to a round-robin slot per thread where neither exists.
+    inline std::size_t currentCpu() noexcept
+    {
+#if defined( ALLOCATORS_HAS_RSEQ )
+        if ( __rseq_size > 0 )
+        {
+            // the kernel rewrites cpu_id whenever the thread migrates
+            auto area = reinterpret_cast<struct rseq const volatile*>(
+                static_cast<char*>( __builtin_thread_pointer() ) + __rseq_offset );
+            const auto cpu = static_cast<std::int32_t>( area->cpu_id );
+            if ( cpu >= 0 )
+                return static_cast<std::size_t>( cpu );
+        }
+#endif
+
+#if defined( __linux__ )
+        const auto cpu = sched_getcpu();
+        if ( cpu >= 0 )
+            return static_cast<std::size_t>( cpu );
+#endif
+
+        return buddylib::threadSlot();
+    }
+}  // namespace allocators
@@ -1,8 +1,10 @@
 #include "FixedAllocator.h"
+#include "SuperblockPool.h"
 
 namespace allocators
 {
-    bool FixedAllocator::makeChunk()
+    template <class IndexType, class AllocationPolicy>
+    bool FixedAllocator<IndexType, AllocationPolicy>::makeChunk()
     {
         try
         {
@@ -11,24 +13,59 @@ namespace allocators
             if ( _chunks.capacity() == size )
             {
                 size = std::max( size, static_cast<decltype( size )>( 8 ) );
+                const auto allocIdx = _allocChunk ? chunkIndex( _allocChunk ) : 0;
+                const auto deallocIdx = _deallocChunk ? chunkIndex( _deallocChunk ) : 0;
                 _chunks.reserve( size * 2 );
+
+                // the chunks moved, so repoint the cached chunks before anything below can fail
+                _allocChunk = _allocChunk ? &_chunks[allocIdx] : nullptr;
+                _deallocChunk = _deallocChunk ? &_chunks[deallocIdx] : nullptr;
+                resizeNonFull();
+
+                for ( auto& chunk : _chunks )
+                    linkChunk( chunk );
             }
-            _chunks.emplace_back( _blockSize, _numBlocks );
+            SizeType minBytes = 0;
+            if constexpr ( AllocationPolicy::ALIGNED_CHUNKS )
+                minBytes = _chunkBytes - AllocationPolicy::HEADER_SIZE;
+            _chunks.emplace_back( _blockSize, _numBlocks, minBytes );
+            linkChunk( _chunks.back() );
         }
         catch ( ... )
         {
             LOG( "makeChunk Threw Exception" );
+            return false;
+        }
+
+        if constexpr ( AllocationPolicy::ALIGNED_CHUNKS )
+        {
+            auto& chunk = _chunks.back();
+            const auto base = chunk._dataPtr - AllocationPolicy::HEADER_SIZE;
+            if ( _pageMap && !_pageMap->insert( base, _chunkBytes, this ) )
+            {
+                LOG( "makeChunk failed to map the chunk" );
+                chunk.release();
+                _chunks.pop_back();
+                return false;
+            }
         }
+
         _allocChunk = &_chunks.back();
         _deallocChunk = &_chunks.front();
+        _nonFull.set( _chunks.size() - 1 );
         return true;
     }
 
-    FixedAllocator::ChunkType* FixedAllocator::findChunk( void* p )
+    template <class IndexType, class AllocationPolicy>
+    typename FixedAllocator<IndexType, AllocationPolicy>::ChunkType*
+    FixedAllocator<IndexType, AllocationPolicy>::findChunk( void* p )
     {
         if ( _chunks.empty() )
             return nullptr;
 
+        if constexpr ( AllocationPolicy::ALIGNED_CHUNKS )
+            return static_cast<ChunkType*>( AllocationPolicy::owner( p, _chunkBytes ) );
+
         // bi directional sliding window
         assert( _deallocChunk );
         const SizeType chunkSize = _blockSize * _numBlocks;
@@ -72,39 +109,106 @@ namespace allocators
         return nullptr;
     }
 
-    FixedAllocator::FixedAllocator()
+    template <class IndexType, class AllocationPolicy>
+    void FixedAllocator<IndexType, AllocationPolicy>::linkChunk( ChunkType& chunk )
+    {
+        if constexpr ( AllocationPolicy::ALIGNED_CHUNKS )
+            AllocationPolicy::owner( chunk._dataPtr, _chunkBytes ) = &chunk;
+    }
+
+    template <class IndexType, class AllocationPolicy>
+    void FixedAllocator<IndexType, AllocationPolicy>::updateNonFull( SizeType idx )
+    {
+        if ( _chunks[idx].isFull() )
+            _nonFull.clear( idx );
+        else
+            _nonFull.set( idx );
+    }
+
+    template <class IndexType, class AllocationPolicy>
+    void FixedAllocator<IndexType, AllocationPolicy>::resizeNonFull()
+    {
+        const auto bits = _chunks.capacity();
+        _nonFullWords.resize( buddylib::HierarchicalBitmap::wordsFor( bits ) );
+        _nonFull.init( _nonFullWords.data(), bits );
+        for ( SizeType idx = 0; idx < _chunks.size(); ++idx )
+            updateNonFull( idx );
+    }
+
+    template <class IndexType, class AllocationPolicy>
+    void FixedAllocator<IndexType, AllocationPolicy>::releaseChunk( ChunkType& chunk )
+    {
+        if constexpr ( AllocationPolicy::ALIGNED_CHUNKS )
+        {
+            if ( _pageMap )
+                _pageMap->erase( chunk._dataPtr - AllocationPolicy::HEADER_SIZE, _chunkBytes );
+        }
+        chunk.release();
+    }
+
+    template <class IndexType, class AllocationPolicy>
+    FixedAllocator<IndexType, AllocationPolicy>::FixedAllocator()
         : _blockSize( 0 )
         , _numBlocks( 0 )
+        , _chunkBytes( 0 )
         , _chunks( 0 )
         , _allocChunk( nullptr )
         , _deallocChunk( nullptr )
         , _emptyChunk( nullptr )
+        , _pageMap( nullptr )
     {
     }
 
-    FixedAllocator::~FixedAllocator()
+    template <class IndexType, class AllocationPolicy>
+    FixedAllocator<IndexType, AllocationPolicy>::~FixedAllocator()
     {
         for ( auto i = std::begin( _chunks ); i != std::end( _chunks ); ++i )
-            i->release();
+            releaseChunk( *i );
     }
 
-    void FixedAllocator::init( SizeType blockSize, SizeType pageSize )
+    template <class IndexType, class AllocationPolicy>
+    void FixedAllocator<IndexType, AllocationPolicy>::init( SizeType blockSize, SizeType pageSize )
     {
         LOG( "blockSize:  %zu | pageSize:  %zu", blockSize, pageSize );
         assert( blockSize > 0 );
         assert( pageSize >= blockSize );
         _blockSize = blockSize;
 
-        auto blockCount = static_cast<DataType>( pageSize / blockSize );
+        assert( blockSize >= sizeof( IndexType ) );
+        auto blockCount = pageSize / blockSize;
+        if constexpr ( AllocationPolicy::ALIGNED_CHUNKS )
+        {
+            // a power of 2 page is filled exactly, header included
+            const auto header = AllocationPolicy::HEADER_SIZE;
+            blockCount = pageSize > header ? ( pageSize - header ) / blockSize : 0;
+        }
+
         if ( blockCount > _maxObjectsPerChunk )
             blockCount = _maxObjectsPerChunk;
         else if ( blockCount < _minObjectsPerChunk )
             blockCount = _minObjectsPerChunk;
 
-        _numBlocks = static_cast<DataType>( blockCount );
+        _numBlocks = static_cast<IndexType>( blockCount );
+
+        if constexpr ( AllocationPolicy::ALIGNED_CHUNKS )
+            _chunkBytes = AllocationPolicy::chunkBytes( _blockSize * _numBlocks );
+    }
+
+    template <class IndexType, class AllocationPolicy>
+    void FixedAllocator<IndexType, AllocationPolicy>::setPageMap(
+        PageMap<FixedAllocator>* pageMap )
+    {
+        assert( _chunks.empty() );
+        assert( !pageMap || AllocationPolicy::ALIGNED_CHUNKS );
+        _pageMap = pageMap;
+
+        // a small IndexType caps chunks below a page, pad them so no two allocators share one
+        if ( _pageMap )
+            _chunkBytes = std::max( _chunkBytes, PageMap<FixedAllocator>::PAGE_SIZE );
     }
 
-    void* FixedAllocator::allocate()
+    template <class IndexType, class AllocationPolicy>
+    void* FixedAllocator<IndexType, AllocationPolicy>::allocate()
     {
         assert( !_emptyChunk || _emptyChunk->_blocksAvailable == _numBlocks );
 
@@ -117,20 +221,11 @@ namespace allocators
             }
             else
             {
-                for ( auto i = std::begin( _chunks );; ++i )
-                {
-                    if ( i == std::end( _chunks ) )
-                    {
-                        if ( !makeChunk() )
-                            return nullptr;
-                        break;
-                    }
-                    if ( !i->isFull() )
-                    {
-                        _allocChunk = &( *i );
-                        break;
-                    }
-                }
+                const auto idx = _chunks.empty() ? buddylib::npos : _nonFull.findFirst();
+                if ( idx != buddylib::npos )
+                    _allocChunk = &_chunks[idx];
+                else if ( !makeChunk() )
+                    return nullptr;
             }
         }
         else if ( _allocChunk == _emptyChunk )
@@ -142,6 +237,8 @@ namespace allocators
         assert( !_allocChunk->isFull() );
 
         auto ptr = _allocChunk->allocate( _blockSize );
+        if ( _allocChunk->isFull() )
+            _nonFull.clear( chunkIndex( _allocChunk ) );
         assert( !_emptyChunk || _emptyChunk->_blocksAvailable == _numBlocks );
 
         LOG( " %p ", ptr );
@@ -157,7 +254,8 @@ namespace allocators
         return ptr;
     }
 
-    bool FixedAllocator::deallocate( void* p, ChunkType* hint )
+    template <class IndexType, class AllocationPolicy>
+    bool FixedAllocator<IndexType, AllocationPolicy>::deallocate( void* p, ChunkType* hint )
     {
         LOG( " PTR :  %p | ChunkHint :  %p ", p, hint );
         assert( !_chunks.empty() );
@@ -191,7 +289,8 @@ namespace allocators
         return true;
     }
 
-    void FixedAllocator::deallocate( void* p )
+    template <class IndexType, class AllocationPolicy>
+    void FixedAllocator<IndexType, AllocationPolicy>::deallocate( void* p )
     {
         LOG( " %p ", p );
 
@@ -200,7 +299,11 @@ namespace allocators
         assert( _deallocChunk->_blocksAvailable != _numBlocks );
         assert( !_emptyChunk || _emptyChunk->_blocksAvailable == _numBlocks );
 
+        const bool wasFull = _deallocChunk->isFull();
         _deallocChunk->deallocate( p, _blockSize );
+        if ( wasFull )
+            _nonFull.set( chunkIndex( _deallocChunk ) );
+
         if ( _deallocChunk->_blocksAvailable == _numBlocks )
         {
             assert( _emptyChunk != _deallocChunk );
@@ -215,9 +318,12 @@ namespace allocators
                 else if ( lastChunk != _emptyChunk )
                 {
                     std::swap( *_emptyChunk, *lastChunk );
+                    linkChunk( *_emptyChunk );
+                    updateNonFull( chunkIndex( _emptyChunk ) );
                 }
                 assert( lastChunk->_blocksAvailable == _numBlocks );
-                lastChunk->release();
+                _nonFull.clear( chunkIndex( lastChunk ) );
+                releaseChunk( *lastChunk );
 
                 _chunks.pop_back();
                 if ( _allocChunk == lastChunk || _allocChunk->isFull() )
@@ -228,7 +334,18 @@ namespace allocators
         assert( !_emptyChunk || _emptyChunk->_blocksAvailable == _numBlocks );
     }
 
-    bool FixedAllocator::freeEmptyChunk()
+    template <class IndexType, class AllocationPolicy>
+    bool FixedAllocator<IndexType, AllocationPolicy>::needsNewChunk() const
+    {
+        if ( _allocChunk && !_allocChunk->isFull() )
+            return false;
+        if ( _emptyChunk )
+            return false;
+        return _chunks.empty() || _nonFull.findFirst() == buddylib::npos;
+    }
+
+    template <class IndexType, class AllocationPolicy>
+    bool FixedAllocator<IndexType, AllocationPolicy>::freeEmptyChunk()
     {
         assert( _emptyChunk == nullptr || _emptyChunk->_blocksAvailable == _numBlocks );
         if ( _emptyChunk == nullptr )
@@ -239,11 +356,15 @@ namespace allocators
 
         auto last = &_chunks.back();
         if ( last != _emptyChunk )             // this is basically what the erase-remove idiom does
+        {
             std::swap( *_emptyChunk, *last );  // it swaps elements to be removed to the end
-                                               // and then erases them all at once
+            linkChunk( *_emptyChunk );         // and then erases them all at once
+            updateNonFull( chunkIndex( _emptyChunk ) );
+        }
         // without the need to move any elements of the vector
         assert( last->_blocksAvailable == _numBlocks );
-        last->release();
+        _nonFull.clear( chunkIndex( last ) );
+        releaseChunk( *last );
         _chunks.pop_back();
 
         if ( _chunks.empty() )
@@ -270,7 +391,8 @@ namespace allocators
         return true;
     }
 
-    bool FixedAllocator::tryToFreeUpSomeMemory()
+    template <class IndexType, class AllocationPolicy>
+    bool FixedAllocator<IndexType, AllocationPolicy>::tryToFreeUpSomeMemory()
     {
         if ( _chunks.empty() )
             assert( !_allocChunk && !_deallocChunk );
@@ -283,7 +405,8 @@ namespace allocators
         return true;
     }
 
-    SizeType FixedAllocator::emptyChunks( bool fast ) const
+    template <class IndexType, class AllocationPolicy>
+    SizeType FixedAllocator<IndexType, AllocationPolicy>::emptyChunks( bool fast ) const
     {
         if ( fast )
             return static_cast<SizeType>( _emptyChunk != nullptr );
@@ -296,7 +419,8 @@ namespace allocators
         return count;
     }
 
-    bool FixedAllocator::isCorrupt() const
+    template <class IndexType, class AllocationPolicy>
+    bool FixedAllocator<IndexType, AllocationPolicy>::isCorrupt() const
     {
         const bool isEmpty = _chunks.empty();
         auto first = std::begin( _chunks );
@@ -344,7 +468,7 @@ namespace allocators
                 assert( false );
                 return true;
             }
-            else if ( !inRange( _chunks, _emptyChunk ) )
+            else if ( _emptyChunk && !inRange( _chunks, _emptyChunk ) )
             {
                 assert( false );
                 return true;
@@ -363,12 +487,23 @@ namespace allocators
             for ( auto const& chunk : _chunks )
                 if ( chunk.isCorrupted( _blockSize, _numBlocks, /*checkIndexes*/ true ) )
                     return true;
+
+            for ( SizeType idx = 0; idx < _chunks.size(); ++idx )
+            {
+                if ( _nonFull.test( idx ) == _chunks[idx].isFull() )
+                {
+                    assert( false );
+                    return true;
+                }
+            }
         }
 
         return false;
     }
 
-    const FixedAllocator::ChunkType* FixedAllocator::hasBlock( void* p ) const
+    template <class IndexType, class AllocationPolicy>
+    const typename FixedAllocator<IndexType, AllocationPolicy>::ChunkType*
+    FixedAllocator<IndexType, AllocationPolicy>::hasBlock( void* p ) const
     {
         LOG( " %p ", p );
         const auto length = _numBlocks * _blockSize;
@@ -378,4 +513,14 @@ namespace allocators
                 return &chunk;
         return nullptr;
     }
+
+    template class FixedAllocator<std::uint8_t>;
+    template class FixedAllocator<std::uint16_t>;
+    template class FixedAllocator<std::uint32_t>;
+    template class FixedAllocator<std::uint8_t, AlignedAllocationPolicy>;
+    template class FixedAllocator<std::uint16_t, AlignedAllocationPolicy>;
+    template class FixedAllocator<std::uint32_t, AlignedAllocationPolicy>;
+    template class FixedAllocator<std::uint8_t, SuperblockAllocationPolicy>;
+    template class FixedAllocator<std::uint16_t, SuperblockAllocationPolicy>;
+    template class FixedAllocator<std::uint32_t, SuperblockAllocationPolicy>;
 }  // namespace allocators
@@ -1,14 +1,19 @@
 #pragma once
 #include <limits>
 #include <vector>
+#include "../BuddyAllocator/HierarchicalBitmap.h"
 #include "Chunk.h"
+#include "PageMap.h"
 
 namespace allocators
 {
+    // IndexType bounds the blocks per chunk, std::uint8_t caps chunks at 255 blocks.
+    // With AlignedAllocationPolicy a block finds its chunk in O(1) instead of scanning the chunks.
+    template <class IndexType = std::uint8_t, class AllocationPolicy = NewAllocationPolicy>
     class FixedAllocator
     {
     public:
-        using ChunkType = DefaultChunk;
+        using ChunkType = Chunk<IndexType, AllocationPolicy>;
         using Chunks = std::vector<ChunkType>;
 
     private:
@@ -19,18 +24,44 @@ namespace allocators
 
         ChunkType* findChunk( void* p );
 
-        DataType _minObjectsPerChunk = 8;
-        DataType _maxObjectsPerChunk = std::numeric_limits<DataType>::max();
+        // points the header of an aligned chunk back at chunk, after it was created or moved
+        void linkChunk( ChunkType& chunk );
+
+        void releaseChunk( ChunkType& chunk );
+
+        inline SizeType chunkIndex( ChunkType const* chunk ) const
+        {
+            return static_cast<SizeType>( chunk - _chunks.data() );
+        }
+
+        // sets or clears the non-full bit of the chunk at idx, after it was moved or changed state
+        void updateNonFull( SizeType idx );
+
+        // regrows the bitmap with the chunk vector
+        void resizeNonFull();
+
+        IndexType _minObjectsPerChunk = 8;
+        IndexType _maxObjectsPerChunk = std::numeric_limits<IndexType>::max();
 
         SizeType _blockSize;
-        DataType _numBlocks;
+        IndexType _numBlocks;
+
+        // size and alignment of an aligned chunk, unused otherwise
+        SizeType _chunkBytes;
 
         Chunks _chunks;
 
+        // one bit per slot of _chunks, set while the chunk has a free block
+        std::vector<buddylib::Word> _nonFullWords;
+        buddylib::HierarchicalBitmap _nonFull;
+
         ChunkType* _allocChunk;
         ChunkType* _deallocChunk;
         ChunkType* _emptyChunk;
 
+        // maps the pages of every chunk to this allocator, optional
+        PageMap<FixedAllocator>* _pageMap;
+
     public:
         FixedAllocator();
 
@@ -46,12 +77,23 @@ namespace allocators
 
         void init( SizeType blockSize, SizeType pageSize );
 
+        // needs aligned chunks, which it pads to at least one map page,
+        // set after init() and before allocating
+        void setPageMap( PageMap<FixedAllocator>* pageMap );
+
         void* allocate();
 
         bool deallocate( void* p, ChunkType* hint );
 
         inline SizeType blockSize() const { return _blockSize; }
 
+        inline SizeType blocksPerChunk() const { return _numBlocks; }
+
+        inline SizeType chunkCount() const { return _chunks.size(); }
+
+        // true when the next allocate() has to create a chunk
+        bool needsNewChunk() const;
+
         bool freeEmptyChunk();
 
         bool tryToFreeUpSomeMemory();
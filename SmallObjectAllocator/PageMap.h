@@ -0,0 +1,138 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+namespace allocators
+{
+    // Radix tree from the 4 KiB pages of a 48 bit address space to T*, three levels of
+    // 4096 entries each. find() takes no locks and can run while other threads insert or erase
+    // other pages. Inner nodes are created on demand and only freed with the map.
+    template <class T>
+    class PageMap
+    {
+    public:
+        static constexpr std::size_t PAGE_SHIFT = 12;
+        static constexpr std::size_t PAGE_SIZE = std::size_t( 1 ) << PAGE_SHIFT;
+        static constexpr std::size_t ADDRESS_BITS = 48;
+
+    private:
+        static constexpr std::size_t LEVEL_BITS = ( ADDRESS_BITS - PAGE_SHIFT ) / 3;
+        static constexpr std::size_t FANOUT = std::size_t( 1 ) << LEVEL_BITS;
+
+        struct Leaf
+        {
+            std::array<std::atomic<T*>, FANOUT> pages;
+        };
+
+        struct Node
+        {
+            std::array<std::atomic<Leaf*>, FANOUT> leaves;
+        };
+
+        std::array<std::atomic<Node*>, FANOUT> _root {};
+
+    private:
+        static inline std::size_t pageOf( void const* p ) noexcept
+        {
+            const auto address = reinterpret_cast<std::uintptr_t>( p );
+            assert( ( address >> ADDRESS_BITS ) == 0 );
+            return address >> PAGE_SHIFT;
+        }
+
+        static inline std::size_t slot( std::size_t page, std::size_t level ) noexcept
+        {
+            return ( page >> ( level * LEVEL_BITS ) ) & ( FANOUT - 1 );
+        }
+
+        // installs a zeroed child unless another thread was first, nullptr when out of memory
+        template <class Child>
+        static Child* getOrCreate( std::atomic<Child*>& slot ) noexcept
+        {
+            auto child = slot.load( std::memory_order_acquire );
+            if ( child )
+                return child;
+
+            auto created = new ( std::nothrow ) Child();
+            if ( !created )
+                return nullptr;
+
+            if ( slot.compare_exchange_strong(
+                     child, created, std::memory_order_acq_rel, std::memory_order_acquire ) )
+                return created;
+
+            delete created;
+            return child;
+        }
+
+        Leaf* findLeaf( std::size_t page ) const noexcept
+        {
+            auto node = _root[slot( page, 2 )].load( std::memory_order_acquire );
+            if ( !node )
+                return nullptr;
+            return node->leaves[slot( page, 1 )].load( std::memory_order_acquire );
+        }
+
+    public:
+        PageMap() = default;
+
+        PageMap( PageMap const& ) = delete;
+        PageMap& operator=( PageMap const& ) = delete;
+
+        ~PageMap()
+        {
+            for ( auto& root : _root )
+            {
+                auto node = root.load( std::memory_order_relaxed );
+                if ( !node )
+                    continue;
+
+                for ( auto& leaf : node->leaves )
+                    delete leaf.load( std::memory_order_relaxed );
+                delete node;
+            }
+        }
+
+        // maps the pages of [begin, begin + bytes) to value, begin and bytes are page aligned
+        bool insert( void const* begin, std::size_t bytes, T* value ) noexcept
+        {
+            assert( reinterpret_cast<std::uintptr_t>( begin ) % PAGE_SIZE == 0 );
+            assert( bytes % PAGE_SIZE == 0 );
+
+            const auto first = pageOf( begin );
+            for ( auto page = first; page < first + bytes / PAGE_SIZE; ++page )
+            {
+                auto node = getOrCreate( _root[slot( page, 2 )] );
+                auto leaf = node ? getOrCreate( node->leaves[slot( page, 1 )] ) : nullptr;
+                if ( !leaf )
+                {
+                    erase( begin, ( page - first ) * PAGE_SIZE );
+                    return false;
+                }
+                leaf->pages[slot( page, 0 )].store( value, std::memory_order_release );
+            }
+            return true;
+        }
+
+        void erase( void const* begin, std::size_t bytes ) noexcept
+        {
+            const auto first = pageOf( begin );
+            for ( auto page = first; page < first + bytes / PAGE_SIZE; ++page )
+            {
+                auto leaf = findLeaf( page );
+                assert( leaf );
+                leaf->pages[slot( page, 0 )].store( nullptr, std::memory_order_release );
+            }
+        }
+
+        // value of the page holding p, nullptr for pages that were never mapped or got erased
+        inline T* find( void const* p ) const noexcept
+        {
+            const auto page = pageOf( p );
+            auto leaf = findLeaf( page );
+            return leaf ? leaf->pages[slot( page, 0 )].load( std::memory_order_acquire ) : nullptr;
+        }
+    };
+}  // namespace allocators
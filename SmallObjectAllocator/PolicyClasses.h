@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <mutex>
 
 namespace allocators
@@ -19,6 +20,12 @@ namespace allocators
             void unlock() const {}
         };
         using Lock = EmptyLock;
+
+        static constexpr std::size_t MAGAZINE_SIZE = 0;
+        static constexpr std::size_t MAGAZINE_BYTES = 0;
+        static constexpr std::size_t FREE_LIST_REFILL = 0;
+        static constexpr bool PER_CPU = false;
+        static constexpr std::size_t OWNED_HEAPS = 0;
     };
 
     template <class MutexPolicy = DEFAULT_MUTEX>
@@ -34,6 +41,59 @@ namespace allocators
             void lock() { _mx.lock(); }
             void unlock() { _mx.unlock(); }
         };
+
+        static constexpr std::size_t MAGAZINE_SIZE = 0;
+        static constexpr std::size_t MAGAZINE_BYTES = 0;
+        static constexpr std::size_t FREE_LIST_REFILL = 0;
+        static constexpr bool PER_CPU = false;
+        static constexpr std::size_t OWNED_HEAPS = 0;
+    };
+
+    // MultiThreaded behind per thread magazines of free blocks, refilled and drained
+    // half a magazine at a time under a single lock. A magazine holds at most MAGAZINE_SIZE
+    // blocks and MAGAZINE_BYTES bytes, a thread's magazines are drained when it exits.
+    template <class MutexPolicy = DEFAULT_MUTEX>
+    class ThreadCached : public MultiThreaded<MutexPolicy>
+    {
+    public:
+        static constexpr std::size_t MAGAZINE_SIZE = 64;
+        static constexpr std::size_t MAGAZINE_BYTES = 4096;
+    };
+
+    // MultiThreaded with a lock free stack of free blocks per size class in front of the locks,
+    // which are only taken to carve FREE_LIST_REFILL blocks at a time out of the chunks.
+    // Freed blocks stay on the stacks, so a size class keeps the chunks of its high water mark
+    // until tryToFreeUpSomeMemory() gives the stacked blocks back to their chunks. Pops are
+    // counted, so that waits until no thread that lost a race can still read a next pointer.
+    template <class MutexPolicy = DEFAULT_MUTEX>
+    class LockFree : public MultiThreaded<MutexPolicy>
+    {
+    public:
+        static constexpr std::size_t FREE_LIST_REFILL = 32;
+    };
+
+    // MultiThreaded with one set of size classes and locks per CPU, a thread allocates from the
+    // shard of the CPU it runs on. Blocks go back to the shard owning their chunk, whichever
+    // thread frees them. Memory grows with the number of cores rather than of threads.
+    template <class MutexPolicy = DEFAULT_MUTEX>
+    class PerCpu : public MultiThreaded<MutexPolicy>
+    {
+    public:
+        static constexpr bool PER_CPU = true;
+    };
+
+    // MultiThreaded with OWNED_HEAPS sets of size classes and locks, the heaps, handed out to
+    // threads round-robin. A chunk belongs to the heap that created it. A thread frees the
+    // blocks of its own heap under the heap's lock, and pushes the blocks of other heaps
+    // onto a lock free remote free list of their heap and size class, which that heap collects
+    // in bulk before it would create a chunk. Heaps outlive their threads, so the remote
+    // frees of a heap whose threads have all exited wait for the next thread handed that heap
+    // to need a chunk of the size class, or for tryToFreeUpSomeMemory(), which collects all.
+    template <class MutexPolicy = DEFAULT_MUTEX>
+    class OwnedHeaps : public MultiThreaded<MutexPolicy>
+    {
+    public:
+        static constexpr std::size_t OWNED_HEAPS = 64;
     };
 
     template <class M>
@@ -43,6 +103,14 @@ namespace allocators
     using SINGLE_THREADING_MODEL = ::allocators::SingleThreaded<M>;
     template <class M>
     using MULTI_THREADING_MODEL = ::allocators::MultiThreaded<M>;
+    template <class M>
+    using THREAD_CACHED_MODEL = ::allocators::ThreadCached<M>;
+    template <class M>
+    using LOCK_FREE_MODEL = ::allocators::LockFree<M>;
+    template <class M>
+    using PER_CPU_MODEL = ::allocators::PerCpu<M>;
+    template <class M>
+    using OWNED_HEAPS_MODEL = ::allocators::OwnedHeaps<M>;
 
 #define DEFAULT_CHUNK_SIZE 4096
 #define MAX_SMALL_OBJECT_SIZE 256
@@ -1,13 +1,38 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../BuddyAllocator/ThreadCaches.h"
+#include "CurrentCpu.h"
 #include "FixedAllocator.h"
+#include "SuperblockPool.h"
 
 namespace allocators
 {
-    template <template<class> class THREADING_POLICY, class MUTEX_POLICY>
+    // INDEX_TYPE bounds the blocks per chunk, std::uint16_t lets a chunk fill a whole page.
+    // Chunks are aligned and registered in a page map, so frees without a size find their
+    // size class in O(1). The chunks of all size classes are carved out of shared superblocks.
+    // Threading policies with a MAGAZINE_SIZE put per thread magazines in front of the locks,
+    // the ones with a FREE_LIST_REFILL lock free stacks of free blocks.
+    // PER_CPU policies keep one shard of size classes and locks per CPU, the page map then
+    // tells the shard of a block as well as its size class. OWNED_HEAPS policies shard the same
+    // way per thread and take frees from other threads through lock free remote free lists.
+    template <
+        template <class> class THREADING_POLICY,
+        class MUTEX_POLICY,
+        class INDEX_TYPE = std::uint16_t>
     class SmallObjectAllocator
     {
     private:
-        FixedAllocator* _allocators;
+        using Allocator = FixedAllocator<INDEX_TYPE, SuperblockAllocationPolicy>;
+
+        // the size classes of shard s start at _allocators[s * classes], same for _locks
+        Allocator* _allocators;
+
+        PageMap<Allocator> _pageMap;
 
         using Lock = typename THREADING_POLICY<MUTEX_POLICY>::Lock;
         Lock* _locks;
@@ -15,9 +40,128 @@ namespace allocators
         const SizeType _maxObjectSize;
         const SizeType _objectAlignSize;
 
+        const SizeType _shards;
+
     private:
-        using ChunkType = typename FixedAllocator::ChunkType;
-        using DefaultAllocator = typename ChunkType::AllocatorPolicy;
+        using ChunkType = typename Allocator::ChunkType;
+        using DefaultAllocator = NewAllocationPolicy;
+
+        static constexpr bool PER_CPU = THREADING_POLICY<MUTEX_POLICY>::PER_CPU;
+        static constexpr SizeType OWNED_HEAPS = THREADING_POLICY<MUTEX_POLICY>::OWNED_HEAPS;
+
+        static constexpr SizeType MAGAZINE_SIZE = THREADING_POLICY<MUTEX_POLICY>::MAGAZINE_SIZE;
+        static constexpr SizeType MAGAZINE_BYTES = THREADING_POLICY<MUTEX_POLICY>::MAGAZINE_BYTES;
+
+        // free blocks cached by one thread, MAGAZINE_SIZE slots per size class
+        struct Magazines
+        {
+            std::vector<SizeType> counts;
+            std::vector<void*> blocks;
+        };
+
+        friend class buddylib::ThreadCacheRegistry<SmallObjectAllocator, Magazines>;
+
+        static constexpr SizeType FREE_LIST_REFILL =
+            THREADING_POLICY<MUTEX_POLICY>::FREE_LIST_REFILL;
+
+        // Treiber stack of the free blocks of one size class, the head packs a 16 bit ABA tag
+        // into the bits above the 48 bit address
+        struct alignas( 64 ) FreeList
+        {
+            std::atomic<std::uintptr_t> head { 0 };
+
+            // pops in progress, a reclaim waits for them before handing blocks back
+            std::atomic<std::uint32_t> poppers { 0 };
+        };
+
+        // yields a reclaim waits for the pops to drain before it puts the stack back
+        static constexpr SizeType MAX_RECLAIM_YIELDS = 64;
+
+        static constexpr std::uintptr_t ADDRESS_MASK =
+            ( std::uintptr_t( 1 ) << PageMap<Allocator>::ADDRESS_BITS ) - 1;
+
+        FreeList* _freeLists;
+
+        // blocks freed by threads not owning their heap, linked through their first bytes,
+        // one list per heap and size class
+        struct alignas( 64 ) RemoteFrees
+        {
+            std::atomic<void*> head { nullptr };
+        };
+
+        RemoteFrees* _remoteFrees;
+
+        // the free lists link blocks through their first bytes, which must fit a pointer
+        static constexpr SizeType MIN_BLOCK_SIZE =
+            FREE_LIST_REFILL > 0 || OWNED_HEAPS > 0 ? sizeof( void* ) : 1;
+
+        // and be aligned for it, every block of a class is when the class size is a multiple
+        static constexpr SizeType BLOCK_ALIGN =
+            FREE_LIST_REFILL > 0 || OWNED_HEAPS > 0 ? alignof( std::atomic<void*> ) : 1;
+
+        // magazines of the threads using this allocator
+        buddylib::ThreadCacheRegistry<SmallObjectAllocator, Magazines> _magazines;
+
+    private:
+        inline SizeType sizeClasses() const
+        {
+            return getOffset( getMaxObjectSize(), getAlignmentSize() );
+        }
+
+        inline SizeType classBlockSize( SizeType idx ) const
+        {
+            const auto size = std::max( ( idx + 1 ) * getAlignmentSize(), MIN_BLOCK_SIZE );
+            return ( size + BLOCK_ALIGN - 1 ) / BLOCK_ALIGN * BLOCK_ALIGN;
+        }
+
+        // first size class of the calling CPU's shard, or of the calling thread's heap
+        inline SizeType shardOffset() const noexcept
+        {
+            if constexpr ( PER_CPU )
+                return currentCpu() % _shards * sizeClasses();
+            else if constexpr ( OWNED_HEAPS > 0 )
+                return buddylib::threadSlot() % _shards * sizeClasses();
+            else
+                return 0;
+        }
+
+        // smaller magazines for larger blocks, so a thread caches at most MAGAZINE_BYTES per class
+        inline SizeType magazineCapacity( SizeType idx ) const
+        {
+            const auto blockSize = ( idx + 1 ) * getAlignmentSize();
+            return std::min( MAGAZINE_SIZE, std::max( SizeType( 2 ), MAGAZINE_BYTES / blockSize ) );
+        }
+
+        // nullptr when the magazines of a new thread could not be created
+        Magazines* localMagazines() noexcept;
+
+        SizeType refill( SizeType idx, void** blocks, SizeType count );
+        void drain( SizeType idx, void** blocks, SizeType count ) noexcept;
+        void flush( Magazines& magazines ) noexcept;
+
+        // false when the block could not be cached
+        bool cache( SizeType idx, void* ptr ) noexcept;
+
+        // a free block's first bytes link it to the next one
+        static inline std::atomic<void*>& nextFree( void* block ) noexcept
+        {
+            return *static_cast<std::atomic<void*>*>( block );
+        }
+
+        void* popFree( SizeType idx ) noexcept;
+        void pushFree( SizeType idx, void* first, void* last ) noexcept;
+
+        // carves a batch of blocks out of the chunks, keeps all but the returned one
+        void* refillFreeList( SizeType idx );
+
+        // gives the blocks on a stack back to their chunks, the caller holds the lock of idx
+        bool reclaimFreeList( SizeType idx ) noexcept;
+
+        void pushRemoteFree( SizeType slot, void* ptr ) noexcept;
+
+        // gives the remote frees of a heap's size class back to its chunks,
+        // the caller holds the lock of slot
+        bool collectRemoteFrees( SizeType slot ) noexcept;
 
     public:
         SmallObjectAllocator() = delete;
@@ -33,10 +177,17 @@ namespace allocators
 
         void deallocate( void* ptr, SizeType size ) noexcept;
 
+        // thread safe like the sized deallocate, ptr may come from allocate() of any size
         void deallocate( void* ptr );
 
+        // releases empty chunks, with a FREE_LIST_REFILL after giving the blocks on the lock free
+        // stacks back to their chunks
         bool tryToFreeUpSomeMemory();
 
+        // drains the magazines of the calling thread and collects the remote frees of its heap,
+        // a no-op without either
+        void flushThreadCache();
+
         bool corrupt() const;
 
         inline SizeType getMaxObjectSize() const { return _maxObjectSize; }
@@ -2,8 +2,9 @@
 
 namespace allocators
 {
-    template < template<class> class THREADING_POLICY, class MUTEX_POLICY>
-    void* SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::allocate( SizeType size )
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void* SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::allocate(
+        SizeType size )
     {
         if ( size > getMaxObjectSize() )
             return DefaultAllocator::alloc( size );
@@ -15,12 +16,43 @@ namespace allocators
         const auto allocatorsSize = getOffset( getMaxObjectSize(), getAlignmentSize() );
 
         assert( idx < allocatorsSize );
-        std::lock_guard<Lock> guard(_locks[idx]);
-        auto& allocator = _allocators[idx];
+
+        if constexpr ( FREE_LIST_REFILL > 0 )
+        {
+            if ( auto ptr = popFree( idx ) )
+                return ptr;
+            if ( auto ptr = refillFreeList( idx ) )
+                return ptr;
+            // the locked path below frees up memory and retries
+        }
+
+        if constexpr ( MAGAZINE_SIZE > 0 )
+        {
+            if ( auto magazines = localMagazines() )
+            {
+                auto& count = magazines->counts[idx];
+                auto blocks = &magazines->blocks[idx * MAGAZINE_SIZE];
+                if ( count == 0 )
+                    count = refill( idx, blocks, magazineCapacity( idx ) / 2 );
+                if ( count > 0 )
+                    return blocks[--count];
+            }
+            // the locked path below frees up memory and retries
+        }
+
+        const auto slot = shardOffset() + idx;
+        std::lock_guard<Lock> guard(_locks[slot]);
+        auto& allocator = _allocators[slot];
         LOG( " Allocating from %p ", &allocator );
 
         assert( allocator.blockSize() >= size );
-        assert( allocator.blockSize() < size + getAlignmentSize() );
+        assert( allocator.blockSize() == classBlockSize( idx ) );
+
+        if constexpr ( OWNED_HEAPS > 0 )
+        {
+            if ( allocator.needsNewChunk() )
+                collectRemoteFrees( slot );
+        }
 
         void* allocated = allocator.allocate();
 
@@ -38,8 +70,10 @@ namespace allocators
         return allocated;
     }
 
-    template <template<class> class THREADING_POLICY, class MUTEX_POLICY>
-    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::deallocate( void* ptr, SizeType size ) noexcept
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::deallocate(
+        void* ptr,
+        SizeType size ) noexcept
     {
         if ( !ptr )
         {
@@ -60,20 +94,39 @@ namespace allocators
         const auto allocatorsSize = getOffset( getMaxObjectSize(), getAlignmentSize() );
         assert( idx < allocatorsSize );
 
+        if constexpr ( PER_CPU || OWNED_HEAPS > 0 )
+        {
+            // the block may come from the shard of another CPU or the heap of another thread
+            deallocate( ptr );
+            return;
+        }
+
+        if constexpr ( FREE_LIST_REFILL > 0 )
+        {
+            pushFree( idx, ptr, ptr );
+            return;
+        }
+
+        if constexpr ( MAGAZINE_SIZE > 0 )
+        {
+            if ( cache( idx, ptr ) )
+                return;
+        }
+
         std::lock_guard<Lock> guard(_locks[idx]);
         auto& allocator = _allocators[idx];
         LOG( " Deallocating from : %p ", &allocator );
 
         assert( allocator.blockSize() >= size );
-        assert( allocator.blockSize() < size + getAlignmentSize() );
+        assert( allocator.blockSize() == classBlockSize( idx ) );
 
         const auto didDeallocate = allocator.deallocate( ptr, /*ChunkHint*/ nullptr );
         assert( didDeallocate );
         LOG( " Did Deallocate: %s ", booleanStr( didDeallocate ) );
     }
 
-    template <template<class> class THREADING_POLICY, class MUTEX_POLICY>
-    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::deallocate( void* ptr )
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::deallocate( void* ptr )
     {
         if ( !ptr )
         {
@@ -84,41 +137,69 @@ namespace allocators
 
         assert( _allocators );
 
-        const auto allocatorsSize = getOffset( getMaxObjectSize(), getAlignmentSize() );
+        auto allocator = _pageMap.find( ptr );
+        if ( !allocator )
+        {
+            DefaultAllocator::free( static_cast<DataType*>( ptr ) );
+            return;
+        }
 
-        FixedAllocator* foundAlloc = nullptr;
-        ChunkType const* foundChunk = nullptr;
+        // the size class, offset by its shard in PER_CPU mode
+        const auto idx = static_cast<SizeType>( allocator - _allocators );
+        assert( idx < _shards * sizeClasses() );
 
-        for ( SizeType i = 0; i < allocatorsSize; ++i )
+        if constexpr ( OWNED_HEAPS > 0 )
         {
-            foundChunk = _allocators[i].hasBlock( ptr );
-            if ( foundChunk )
+            if ( idx - idx % sizeClasses() != shardOffset() )
             {
-                foundAlloc = &_allocators[i];
-                break;
+                pushRemoteFree( idx, ptr );
+                return;
             }
         }
 
-        if ( !foundAlloc )
+        if constexpr ( FREE_LIST_REFILL > 0 )
         {
-            DefaultAllocator::free( static_cast<DataType*>( ptr ) );
+            pushFree( idx, ptr, ptr );
             return;
         }
 
-        assert( foundChunk );
-        const auto didDeallocate =
-            foundAlloc->deallocate( ptr, const_cast<ChunkType*>( foundChunk ) );
+        if constexpr ( MAGAZINE_SIZE > 0 )
+        {
+            if ( cache( idx, ptr ) )
+                return;
+        }
+
+        std::lock_guard<Lock> guard( _locks[idx] );
+        const auto didDeallocate = allocator->deallocate( ptr, /*ChunkHint*/ nullptr );
 
         assert( didDeallocate );
         LOG( " DidDeallocate : %s ", booleanStr( didDeallocate ) );
     }
 
-    template <template<class> class THREADING_POLICY, class MUTEX_POLICY>
-    bool SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::tryToFreeUpSomeMemory()
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    bool SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::tryToFreeUpSomeMemory()
     {
         bool didFreeMemory = false;
 
-        const auto allocatorsSize = getOffset( getMaxObjectSize(), getAlignmentSize() );
+        const auto allocatorsSize = _shards * sizeClasses();
+
+        if constexpr ( FREE_LIST_REFILL > 0 )
+        {
+            for ( SizeType i = 0; i < allocatorsSize; ++i )
+            {
+                std::lock_guard<Lock> guard( _locks[i] );
+                didFreeMemory |= reclaimFreeList( i );
+            }
+        }
+
+        if constexpr ( OWNED_HEAPS > 0 )
+        {
+            for ( SizeType i = 0; i < allocatorsSize; ++i )
+            {
+                std::lock_guard<Lock> guard( _locks[i] );
+                didFreeMemory |= collectRemoteFrees( i );
+            }
+        }
 
         for ( SizeType i = 0; i < allocatorsSize; ++i )
         {
@@ -135,8 +216,269 @@ namespace allocators
         return didFreeMemory;
     }
 
-    template <template<class> class THREADING_POLICY, class MUTEX_POLICY>
-    bool SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::corrupt() const
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    typename SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::Magazines*
+    SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::localMagazines() noexcept
+    {
+        auto magazines = _magazines.local( [this]( Magazines& created ) {
+            const auto classes = sizeClasses();
+            created.counts.resize( classes );
+            created.blocks.resize( classes * MAGAZINE_SIZE );
+        } );
+        if ( !magazines )
+        {
+            LOG( "Failed to create the magazines of a thread" );
+        }
+        return magazines;
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    SizeType SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::refill(
+        SizeType idx,
+        void** blocks,
+        SizeType count )
+    {
+        std::lock_guard<Lock> guard( _locks[idx] );
+        auto& allocator = _allocators[idx];
+        for ( SizeType i = 0; i < count; ++i )
+        {
+            blocks[i] = allocator.allocate();
+            if ( !blocks[i] )
+                return i;
+        }
+        return count;
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::drain(
+        SizeType idx,
+        void** blocks,
+        SizeType count ) noexcept
+    {
+        std::lock_guard<Lock> guard( _locks[idx] );
+        auto& allocator = _allocators[idx];
+        for ( SizeType i = 0; i < count; ++i )
+        {
+            const auto didDeallocate = allocator.deallocate( blocks[i], /*ChunkHint*/ nullptr );
+            assert( didDeallocate );
+            ( void )didDeallocate;
+        }
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::flush(
+        Magazines& magazines ) noexcept
+    {
+        for ( SizeType idx = 0; idx < magazines.counts.size(); ++idx )
+        {
+            drain( idx, &magazines.blocks[idx * MAGAZINE_SIZE], magazines.counts[idx] );
+            magazines.counts[idx] = 0;
+        }
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    bool SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::cache(
+        SizeType idx,
+        void* ptr ) noexcept
+    {
+        auto magazines = localMagazines();
+        if ( !magazines )
+            return false;
+
+        auto& count = magazines->counts[idx];
+        auto blocks = &magazines->blocks[idx * MAGAZINE_SIZE];
+        const auto capacity = magazineCapacity( idx );
+        if ( count == capacity )
+        {
+            // the bottom half was freed the longest ago, the top half is still warm
+            const auto half = capacity / 2;
+            drain( idx, blocks, half );
+            std::memmove( blocks, blocks + half, ( count - half ) * sizeof( void* ) );
+            count -= half;
+        }
+        blocks[count++] = ptr;
+        return true;
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void* SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::popFree(
+        SizeType idx ) noexcept
+    {
+        auto& list = _freeLists[idx];
+
+        // counted before the head is read, see reclaimFreeList()
+        list.poppers.fetch_add( 1 );
+        auto current = list.head.load();
+        void* block = nullptr;
+        while ( true )
+        {
+            block = reinterpret_cast<void*>( current & ADDRESS_MASK );
+            if ( !block )
+                break;
+
+            // the block may be popped and reused meanwhile, the tag then fails the exchange
+            const auto next = reinterpret_cast<std::uintptr_t>(
+                nextFree( block ).load( std::memory_order_relaxed ) );
+            const auto tag = ( current & ~ADDRESS_MASK ) + ( ADDRESS_MASK + 1 );
+            if ( list.head.compare_exchange_weak(
+                     current, next | tag, std::memory_order_acquire, std::memory_order_acquire ) )
+                break;
+        }
+        list.poppers.fetch_sub( 1, std::memory_order_release );
+        return block;
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::pushFree(
+        SizeType idx,
+        void* first,
+        void* last ) noexcept
+    {
+        auto& head = _freeLists[idx].head;
+        auto current = head.load( std::memory_order_relaxed );
+        do
+        {
+            nextFree( last ).store(
+                reinterpret_cast<void*>( current & ADDRESS_MASK ), std::memory_order_relaxed );
+        } while ( !head.compare_exchange_weak(
+            current,
+            reinterpret_cast<std::uintptr_t>( first ) | ( current & ~ADDRESS_MASK ),
+            std::memory_order_release,
+            std::memory_order_relaxed ) );
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void* SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::refillFreeList(
+        SizeType idx )
+    {
+        void* first = nullptr;
+        void* last = nullptr;
+        void* block = nullptr;
+        {
+            std::lock_guard<Lock> guard( _locks[idx] );
+            auto& allocator = _allocators[idx];
+
+            block = allocator.allocate();
+            for ( SizeType i = 1; block && i < FREE_LIST_REFILL; ++i )
+            {
+                auto next = allocator.allocate();
+                if ( !next )
+                    break;
+
+                nextFree( next ).store( first, std::memory_order_relaxed );
+                first = next;
+                if ( !last )
+                    last = next;
+            }
+        }
+
+        if ( first )
+            pushFree( idx, first, last );
+        return block;
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    bool SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::reclaimFreeList(
+        SizeType idx ) noexcept
+    {
+        // take the whole stack, the tag moves on as for a pop
+        auto& list = _freeLists[idx];
+        auto current = list.head.load( std::memory_order_relaxed );
+        while ( ( current & ADDRESS_MASK ) != 0 &&
+                !list.head.compare_exchange_weak(
+                    current, ( current & ~ADDRESS_MASK ) + ( ADDRESS_MASK + 1 ) ) )
+        {
+        }
+
+        auto first = reinterpret_cast<void*>( current & ADDRESS_MASK );
+        if ( !first )
+            return false;
+
+        // A pop that read the old head may still read the link of a taken block, and the block
+        // must stay mapped until it did. Pops that start later only see the blocks pushed since,
+        // so one moment without pops is enough. Under steady traffic put the stack back.
+        for ( SizeType yields = 0; list.poppers.load() != 0; ++yields )
+        {
+            if ( yields == MAX_RECLAIM_YIELDS )
+            {
+                auto last = first;
+                while ( auto next = nextFree( last ).load( std::memory_order_relaxed ) )
+                    last = next;
+                pushFree( idx, first, last );
+                return false;
+            }
+            std::this_thread::yield();
+        }
+
+        auto& allocator = _allocators[idx];
+        for ( auto block = first; block; )
+        {
+            auto next = nextFree( block ).load( std::memory_order_relaxed );
+            const auto didDeallocate = allocator.deallocate( block, /*ChunkHint*/ nullptr );
+            assert( didDeallocate );
+            ( void )didDeallocate;
+            block = next;
+        }
+        return true;
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::pushRemoteFree(
+        SizeType slot,
+        void* ptr ) noexcept
+    {
+        // any number of threads push, the owner takes the whole list at once, so no ABA
+        auto& head = _remoteFrees[slot].head;
+        auto current = head.load( std::memory_order_relaxed );
+        do
+        {
+            nextFree( ptr ).store( current, std::memory_order_relaxed );
+        } while ( !head.compare_exchange_weak(
+            current, ptr, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    bool SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::collectRemoteFrees(
+        SizeType slot ) noexcept
+    {
+        auto block = _remoteFrees[slot].head.exchange( nullptr, std::memory_order_acquire );
+        if ( !block )
+            return false;
+
+        auto& allocator = _allocators[slot];
+        while ( block )
+        {
+            auto next = nextFree( block ).load( std::memory_order_relaxed );
+            const auto didDeallocate = allocator.deallocate( block, /*ChunkHint*/ nullptr );
+            assert( didDeallocate );
+            ( void )didDeallocate;
+            block = next;
+        }
+        return true;
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    void SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::flushThreadCache()
+    {
+        if constexpr ( MAGAZINE_SIZE > 0 )
+        {
+            if ( auto magazines = localMagazines() )
+                flush( *magazines );
+        }
+
+        if constexpr ( OWNED_HEAPS > 0 )
+        {
+            const auto heap = shardOffset();
+            for ( SizeType idx = 0; idx < sizeClasses(); ++idx )
+            {
+                std::lock_guard<Lock> guard( _locks[heap + idx] );
+                collectRemoteFrees( heap + idx );
+            }
+        }
+    }
+
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    bool SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::corrupt() const
     {
         if ( !_allocators || getAlignmentSize() == 0 || getMaxObjectSize() == 0 )
         {
@@ -146,7 +488,7 @@ namespace allocators
             return true;
         }
 
-        const auto allocatorsSize = getOffset( getMaxObjectSize(), getAlignmentSize() );
+        const auto allocatorsSize = _shards * sizeClasses();
         for ( SizeType i = 0; i < allocatorsSize; ++i )
         {
             std::lock_guard<Lock> guard(_locks[i]);
@@ -157,34 +499,58 @@ namespace allocators
         return false;
     }
 
-    template <template<class> class THREADING_POLICY, class MUTEX_POLICY>
-    SizeType SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::getOffset( SizeType numBytes, SizeType alignment )
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    SizeType SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::getOffset(
+        SizeType numBytes,
+        SizeType alignment )
     {
         const auto extra = alignment - 1;
         return ( numBytes + extra ) / alignment;
     }
 
-    template <template<class> class THREADING_POLICY, class MUTEX_POLICY>
-    SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::SmallObjectAllocator(
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::SmallObjectAllocator(
         SizeType pageSize,
         SizeType maxObjectSize,
         SizeType objectAlignSize )
-        : _maxObjectSize( maxObjectSize )
+        : _allocators( nullptr )
+        , _maxObjectSize( maxObjectSize )
         , _objectAlignSize( objectAlignSize )
-        , _allocators( nullptr )
+        , _shards(
+              PER_CPU       ? std::max( 1u, std::thread::hardware_concurrency() )
+              : OWNED_HEAPS ? OWNED_HEAPS
+                            : 1 )
+        , _freeLists( nullptr )
+        , _remoteFrees( nullptr )
+        , _magazines( *this )
     {
         LOG( " SmallObjectAllocator %p", this );
-        const auto allocCount = getOffset( maxObjectSize, objectAlignSize );
-        _allocators = new FixedAllocator[allocCount];
+        const auto classes = sizeClasses();
+        const auto allocCount = _shards * classes;
+        _allocators = new Allocator[allocCount];
         _locks = new Lock[allocCount];
+        if constexpr ( FREE_LIST_REFILL > 0 )
+            _freeLists = new FreeList[classes];
+        if constexpr ( OWNED_HEAPS > 0 )
+            _remoteFrees = new RemoteFrees[allocCount];
 
+        // every chunk covers whole pages of the page map
+        pageSize = std::max( pageSize, PageMap<Allocator>::PAGE_SIZE );
         for ( SizeType i = 0; i < allocCount; ++i )
-            _allocators[i].init( ( i + 1 ) * objectAlignSize, pageSize );
+        {
+            _allocators[i].init( classBlockSize( i % classes ), pageSize );
+            _allocators[i].setPageMap( &_pageMap );
+        }
     }
-    template<template<class>class THREADING_POLICY, class MUTEX_POLICY>
-    inline SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY>::~SmallObjectAllocator()
+    template <template <class> class THREADING_POLICY, class MUTEX_POLICY, class INDEX_TYPE>
+    inline SmallObjectAllocator<THREADING_POLICY, MUTEX_POLICY, INDEX_TYPE>::~SmallObjectAllocator()
     {
+        // the blocks still cached by other threads go away with the chunks
+        _magazines.detachThreads();
+
         delete[] _allocators;
         delete[] _locks;
+        delete[] _freeLists;
+        delete[] _remoteFrees;
     }
 }  // namespace allocators
@@ -33,7 +33,10 @@ namespace allocators
         }
 
         inline SmallObjectAllocatorSingleton()
-            : SmallObjectAllocator( chunkSize, maxSmallObjectSize, objectAlignSize )
+            : SmallObjectAllocator<ThreadingPolicy, MutexPolicy>(
+                  chunkSize,
+                  maxSmallObjectSize,
+                  objectAlignSize )
         {
         }
 
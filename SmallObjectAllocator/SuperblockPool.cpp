@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include "SuperblockPool.h"
+
+namespace allocators
+{
+    SuperblockPool& SuperblockPool::instance()
+    {
+        static SuperblockPool* pool = new SuperblockPool();
+        return *pool;
+    }
+
+    std::size_t SuperblockPool::sizeClass( std::size_t bytes ) noexcept
+    {
+        assert( bytes && ( bytes & ( bytes - 1 ) ) == 0 );
+        std::size_t idx = 0;
+        while ( ( std::size_t( 1 ) << idx ) < bytes )
+            ++idx;
+        return idx;
+    }
+
+    void* SuperblockPool::upstreamAllocate( std::size_t bytes ) noexcept
+    {
+        return ::operator new( bytes, std::align_val_t( bytes ), std::nothrow );
+    }
+
+    void SuperblockPool::upstreamDeallocate( void* ptr, std::size_t bytes ) noexcept
+    {
+        ::operator delete( ptr, std::align_val_t( bytes ) );
+    }
+
+    void SuperblockPool::link( Superblock* superblock ) noexcept
+    {
+        auto& head = _partial[sizeClass( superblock->slotSize )];
+        superblock->prev = nullptr;
+        superblock->next = head;
+        if ( head )
+            head->prev = superblock;
+        head = superblock;
+    }
+
+    void SuperblockPool::unlink( Superblock* superblock ) noexcept
+    {
+        if ( superblock->prev )
+            superblock->prev->next = superblock->next;
+        else
+            _partial[sizeClass( superblock->slotSize )] = superblock->next;
+
+        if ( superblock->next )
+            superblock->next->prev = superblock->prev;
+    }
+
+    void* SuperblockPool::allocate( std::size_t bytes ) noexcept
+    {
+        static_assert( MIN_SLOT_SIZE >= sizeof( Superblock ), "the header must fit a slot" );
+        bytes = std::max( bytes, MIN_SLOT_SIZE );
+        if ( bytes > MAX_SLOT_SIZE )
+        {
+            std::lock_guard<std::mutex> guard { _mutex };
+            ++_upstreamCalls;
+            return upstreamAllocate( bytes );
+        }
+
+        const auto slots = SUPERBLOCK_SIZE / bytes;
+
+        std::lock_guard<std::mutex> guard { _mutex };
+        auto superblock = _partial[sizeClass( bytes )];
+        if ( !superblock )
+        {
+            auto memory = upstreamAllocate( SUPERBLOCK_SIZE );
+            if ( !memory )
+                return nullptr;
+
+            ++_superblocks;
+            ++_upstreamCalls;
+
+            // the header takes the first slot
+            superblock = new ( memory ) Superblock { nullptr, nullptr, nullptr, bytes, 0, 1 };
+            link( superblock );
+        }
+
+        void* slot;
+        if ( superblock->freeSlots )
+        {
+            slot = superblock->freeSlots;
+            superblock->freeSlots = *static_cast<void**>( slot );
+        }
+        else
+        {
+            // untouched slots are carved lazily so their pages stay uncommitted until used
+            assert( superblock->carvedSlots < slots );
+            slot = reinterpret_cast<char*>( superblock ) + superblock->carvedSlots++ * bytes;
+        }
+
+        if ( ++superblock->usedSlots == slots - 1 )
+            unlink( superblock );
+        return slot;
+    }
+
+    void SuperblockPool::deallocate( void* ptr, std::size_t bytes ) noexcept
+    {
+        bytes = std::max( bytes, MIN_SLOT_SIZE );
+        if ( bytes > MAX_SLOT_SIZE )
+        {
+            upstreamDeallocate( ptr, bytes );
+            return;
+        }
+
+        const auto address = reinterpret_cast<std::uintptr_t>( ptr );
+        auto superblock = reinterpret_cast<Superblock*>( address & ~( SUPERBLOCK_SIZE - 1 ) );
+        assert( superblock->slotSize == bytes );
+
+        const auto slots = SUPERBLOCK_SIZE / bytes;
+
+        std::lock_guard<std::mutex> guard { _mutex };
+        if ( superblock->usedSlots-- == slots - 1 )
+            link( superblock );
+
+        if ( superblock->usedSlots == 0 )
+        {
+            unlink( superblock );
+            --_superblocks;
+            upstreamDeallocate( superblock, SUPERBLOCK_SIZE );
+            return;
+        }
+
+        *static_cast<void**>( ptr ) = superblock->freeSlots;
+        superblock->freeSlots = ptr;
+    }
+
+    std::size_t SuperblockPool::superblocks() const
+    {
+        std::lock_guard<std::mutex> guard { _mutex };
+        return _superblocks;
+    }
+
+    std::size_t SuperblockPool::upstreamCalls() const
+    {
+        std::lock_guard<std::mutex> guard { _mutex };
+        return _upstreamCalls;
+    }
+}  // namespace allocators
@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <mutex>
+#include "Chunk.h"
+
+namespace allocators
+{
+    // Carves power of 2 sized, size aligned slots out of SUPERBLOCK_SIZE regions taken from the
+    // upstream allocator, so chunks of all size classes share a few large regions.
+    // A superblock serves a single slot size, its first slot holds its header.
+    // It goes back upstream as a whole once all its slots are free.
+    // Larger slots than MAX_SLOT_SIZE go straight upstream. Thread safe.
+    class SuperblockPool
+    {
+    public:
+        static constexpr std::size_t SUPERBLOCK_SIZE = std::size_t( 1 ) << 20;
+        static constexpr std::size_t MAX_SLOT_SIZE = SUPERBLOCK_SIZE / 16;
+
+        // smaller requests get a slot of this size, which also fits the header
+        static constexpr std::size_t MIN_SLOT_SIZE = 64;
+
+    private:
+        struct Superblock
+        {
+            // list of the superblocks of the same slot size with free slots
+            Superblock* prev;
+            Superblock* next;
+
+            // slots given back, linked through their first bytes
+            void* freeSlots;
+
+            std::size_t slotSize;
+            std::size_t usedSlots;
+
+            // slots past this one were never handed out
+            std::size_t carvedSlots;
+        };
+
+        static constexpr std::size_t SIZE_CLASSES = 64;
+
+        std::array<Superblock*, SIZE_CLASSES> _partial {};
+
+        std::size_t _superblocks = 0;
+        std::size_t _upstreamCalls = 0;
+
+        mutable std::mutex _mutex;
+
+    private:
+        SuperblockPool() = default;
+
+        static std::size_t sizeClass( std::size_t bytes ) noexcept;
+
+        static void* upstreamAllocate( std::size_t bytes ) noexcept;
+        static void upstreamDeallocate( void* ptr, std::size_t bytes ) noexcept;
+
+        void link( Superblock* superblock ) noexcept;
+        void unlink( Superblock* superblock ) noexcept;
+
+    public:
+        SuperblockPool( SuperblockPool const& ) = delete;
+        SuperblockPool& operator=( SuperblockPool const& ) = delete;
+
+        // never destroyed, chunks may be released by static objects during shutdown
+        static SuperblockPool& instance();
+
+        // bytes is a power of 2, the slot is aligned to it, nullptr when out of memory
+        void* allocate( std::size_t bytes ) noexcept;
+
+        void deallocate( void* ptr, std::size_t bytes ) noexcept;
+
+        // superblocks currently held
+        std::size_t superblocks() const;
+
+        // allocations from the upstream allocator so far, superblocks and oversized slots
+        std::size_t upstreamCalls() const;
+    };
+
+    // Aligned chunks living in the superblocks of SuperblockPool::instance()
+    struct SuperblockAllocationPolicy : AlignedAllocationPolicy
+    {
+        static DataType* alloc( std::size_t s )
+        {
+            const auto bytes = chunkBytes( s );
+            auto base = static_cast<DataType*>( SuperblockPool::instance().allocate( bytes ) );
+            if ( !base )
+                return nullptr;
+
+            new ( base ) Header { nullptr, bytes };
+            return base + HEADER_SIZE;
+        }
+
+        static void free( DataType* ptr )
+        {
+            auto base = ptr - HEADER_SIZE;
+            const auto bytes = reinterpret_cast<Header*>( base )->bytes;
+            SuperblockPool::instance().deallocate( base, bytes );
+        }
+    };
+}  // namespace allocators
@@ -25,7 +25,7 @@ auto bench_multithreaded(
     Func&& f,
     size_t threads = std::thread::hardware_concurrency() )
 {
-    std::vector<std::future<unsigned long long>> futures;
+    std::vector<std::future<decltype( bench( iterations, f ) )>> futures;
     for ( auto i = 0; i < threads; ++i )
         futures.push_back(
             std::async( std::launch::async, [&]() { return bench( iterations / threads, f ); } ) );
@@ -59,3 +59,15 @@ auto bench_multithreaded(
         std::cerr << "Test multithread alloc with 9 threads: " << #name #size                      \
                   << " finished for: " << time << std::endl;                                       \
     }
+
+#define REGISTER_BM_SCALING_TEST( name, func, size, base, ... )                                   \
+    TEST( BenchmarkScaling, name##size )                                                          \
+    {                                                                                             \
+        for ( std::size_t threads = 1; threads <= 64; threads *= 2 )                              \
+        {                                                                                         \
+            auto time = bench_multithreaded(                                                      \
+                /*iterations*/ 64 * 100, func<base<size>, __VA_ARGS__>, threads );                \
+            std::cerr << "Test multithread alloc with " << threads << " threads: " << #name #size \
+                      << " finished for: " << time << std::endl;                                  \
+        }                                                                                         \
+    }
@@ -1,7 +1,17 @@
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+
 #include "Benchmark.h"
 #include "BuddyAllocator/BuddyAllocator.h"
+#include "BuddyAllocator/CachedBuddyAllocator.h"
+#include "BuddyAllocator/RegionBuddyAllocator.h"
+#include "BuddyAllocator/ShardedBuddyAllocator.h"
 #include "BuddyAllocator/ThreadingPolicies.h"
 
 using namespace buddy;
@@ -132,3 +142,492 @@ TEST( BuddyAllocatorTests, TestPerformanceFor69byteObjects )
 
     EXPECT_LE( buddyTime, mallocTime);
 }
+
+template <class Allocator>
+void shuffledAllocDealloc(
+    Allocator& alloc,
+    std::vector<void*>& ptrs,
+    std::vector<std::size_t> const& order,
+    std::size_t allocSize )
+{
+    for ( auto i = 0; i < ptrs.size(); ++i )
+    {
+        ptrs[i] = alloc.allocate( allocSize );
+    }
+
+    for ( auto i : order )
+    {
+        alloc.deallocate( ptrs[i], allocSize );
+    }
+}
+
+TEST( BuddyAllocatorTests, TestThroughputForShuffledDeallocations )
+{
+    constexpr std::size_t allocations = 1 << 12;
+    constexpr std::size_t allocSize = 256;
+    constexpr std::size_t iterations = 100;
+
+    std::vector<void*> ptrs( allocations );
+    std::vector<std::size_t> order( allocations );
+    for ( auto i = 0; i < allocations; ++i )
+        order[i] = i;
+    std::shuffle( std::begin( order ), std::end( order ), std::mt19937 { 42 } );
+
+    BuddyAllocator<24, 6, SingleThreaded> buddy;
+    auto buddyTime = bench(
+        iterations, [&]() { shuffledAllocDealloc( buddy, ptrs, order, allocSize ); } );
+
+    MallocAllocator mallocAlloc;
+    auto mallocTime = bench(
+        iterations, [&]() { shuffledAllocDealloc( mallocAlloc, ptrs, order, allocSize ); } );
+
+    const auto opsPerSec = []( auto time ) { return 2 * allocations * 1000000000ull / time; };
+    std::cerr << "Buddy ops/sec: " << opsPerSec( buddyTime ) << std::endl;
+    std::cerr << "Malloc ops/sec: " << opsPerSec( mallocTime ) << std::endl;
+
+    EXPECT_EQ( buddy.freeNodesPerLevel().front(), 1 );
+}
+
+TEST( BuddyAllocatorTests, TestThroughputFor1GiBArenaWith64byteBlocks )
+{
+    constexpr std::size_t allocations = 1 << 16;
+    constexpr std::size_t iterations = 10;
+
+    std::vector<void*> ptrs( allocations );
+    std::vector<std::size_t> sizes( allocations );
+    std::vector<std::size_t> order( allocations );
+    std::mt19937 rng { 42 };
+    for ( auto i = 0; i < allocations; ++i )
+    {
+        sizes[i] = std::size_t( 64 ) << ( rng() % 7 );
+        order[i] = i;
+    }
+    std::shuffle( std::begin( order ), std::end( order ), rng );
+
+    auto buddy = std::make_unique<BuddyAllocator<30, 6, SingleThreaded>>();
+    auto buddyTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < allocations; ++i )
+            ptrs[i] = buddy->allocate( sizes[i] );
+        for ( auto i : order )
+            buddy->deallocate( ptrs[i], sizes[i] );
+    } );
+
+    std::cerr << "Buddy ops/sec: " << 2 * allocations * 1000000000ull / buddyTime << std::endl;
+
+    EXPECT_EQ( buddy->freeNodesPerLevel().front(), 1 );
+}
+
+TEST( BuddyAllocatorTests, TestThroughputForSizelessDeallocations )
+{
+    constexpr std::size_t allocations = 1 << 14;
+    constexpr std::size_t iterations = 100;
+
+    std::vector<void*> ptrs( allocations );
+    std::vector<std::size_t> sizes( allocations );
+    std::vector<std::size_t> order( allocations );
+    std::mt19937 rng { 42 };
+    for ( auto i = 0; i < allocations; ++i )
+    {
+        sizes[i] = 1 + rng() % 2048;
+        order[i] = i;
+    }
+    std::shuffle( std::begin( order ), std::end( order ), rng );
+
+    BuddyAllocator<26, 6, SingleThreaded> buddy;
+    auto buddyTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < allocations; ++i )
+            ptrs[i] = buddy.allocate( sizes[i] );
+        for ( auto i : order )
+            buddy.deallocate( ptrs[i] );
+    } );
+
+    auto mallocTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < allocations; ++i )
+            ptrs[i] = malloc( sizes[i] );
+        for ( auto i : order )
+            free( ptrs[i] );
+    } );
+
+    const auto opsPerSec = []( auto time ) { return 2 * allocations * 1000000000ull / time; };
+    std::cerr << "Buddy ops/sec: " << opsPerSec( buddyTime ) << std::endl;
+    std::cerr << "Malloc ops/sec: " << opsPerSec( mallocTime ) << std::endl;
+
+    EXPECT_EQ( buddy.freeNodesPerLevel().front(), 1 );
+}
+
+TEST( BuddyAllocatorTests, TestShardedAllocatorFallsBackToOtherArenas )
+{
+    ShardedBuddyAllocator<16, 6> sharded( 2 );
+
+    auto first = sharded.allocate( 1 << 16 );
+    auto second = sharded.allocate( 1 << 16 );
+    ASSERT_NE( first, nullptr );
+    ASSERT_NE( second, nullptr );
+    EXPECT_EQ( sharded.allocate( 64 ), nullptr );
+
+    sharded.deallocate( first );
+    sharded.deallocate( second, 1 << 16 );
+    EXPECT_EQ( sharded.arena( 0 ).freeNodesPerLevel().front(), 1 );
+    EXPECT_EQ( sharded.arena( 1 ).freeNodesPerLevel().front(), 1 );
+}
+
+TEST( BuddyAllocatorTests, TestRegionAllocatorWithMetadataInsideRegion )
+{
+    constexpr std::size_t regionSize = 3 * ( 1 << 20 ) + 4096 + 100;
+    constexpr std::size_t allocSize = 4096;
+    std::vector<uint8_t> region( regionSize );
+
+    RegionBuddyAllocator<SingleThreaded> buddy( region.data(), region.size(), 64 );
+    const auto metadataSize = RegionBuddyAllocator<SingleThreaded>::metadataSize( regionSize, 64 );
+    const auto initialFreeNodes = buddy.freeNodesPerLevel();
+
+    std::vector<void*> ptrs;
+    while ( auto ptr = buddy.allocate( allocSize ) )
+    {
+        EXPECT_GE( static_cast<uint8_t*>( ptr ), region.data() + metadataSize );
+        EXPECT_LE( static_cast<uint8_t*>( ptr ) + allocSize, region.data() + regionSize );
+        ptrs.push_back( ptr );
+    }
+    EXPECT_GE( ptrs.size() * allocSize, regionSize - metadataSize - 2 * allocSize );
+
+    for ( auto ptr : ptrs )
+        buddy.deallocate( ptr );
+
+    const auto freeNodes = buddy.freeNodesPerLevel();
+    EXPECT_TRUE( std::equal(
+        std::begin( freeNodes ), std::end( freeNodes ), std::begin( initialFreeNodes ) ) );
+}
+
+TEST( BuddyAllocatorTests, TestRegionAllocatorWithSeparateMetadata )
+{
+    constexpr std::size_t regionSize = 5 * 4096;
+    std::vector<uint8_t> region( regionSize );
+    std::vector<uint8_t> metadata(
+        RegionBuddyAllocator<SingleThreaded>::metadataSize( regionSize, 4096 ) );
+
+    RegionBuddyAllocator<SingleThreaded> buddy(
+        region.data(), region.size(), 4096, metadata.data(), metadata.size() );
+
+    // the 4 block half and the single block after it, the rest of the 8 block tree does not exist
+    auto first = buddy.allocate( 4 * 4096 );
+    auto second = buddy.allocate( 4096 );
+    EXPECT_EQ( first, region.data() );
+    EXPECT_EQ( second, region.data() + 4 * 4096 );
+    EXPECT_EQ( buddy.allocate( 4096 ), nullptr );
+
+    buddy.deallocate( second );
+    buddy.deallocate( first, 4 * 4096 );
+    EXPECT_EQ( buddy.freeNodesPerLevel()[1], 1 );
+    EXPECT_EQ( buddy.freeNodesPerLevel()[3], 1 );
+}
+
+TEST( BuddyAllocatorTests, TestReallocateResizesInPlace )
+{
+    BuddyAllocator<16, 6, SingleThreaded> buddy;
+
+    auto ptr = static_cast<uint8_t*>( buddy.allocate( 64 ) );
+    std::memset( ptr, 0xAB, 64 );
+    EXPECT_EQ( buddy.reallocate( ptr, 64, 4096 ), ptr );
+
+    // the neighbour takes the buddy of the grown block, so growing further has to move
+    auto neighbour = buddy.allocate( 64 );
+    EXPECT_EQ( neighbour, ptr + 4096 );
+    auto moved = static_cast<uint8_t*>( buddy.reallocate( ptr, 4096, 8192 ) );
+    EXPECT_NE( moved, ptr );
+    EXPECT_EQ( moved[63], 0xAB );
+
+    buddy.deallocate( moved );
+    buddy.deallocate( neighbour );
+    EXPECT_EQ( buddy.freeNodesPerLevel().front(), 1 );
+
+    // shrinking the whole arena frees its upper halves
+    BuddyAllocator<13, 6, SingleThreaded> small;
+    auto whole = static_cast<uint8_t*>( small.allocate( 8192 ) );
+    EXPECT_EQ( small.reallocate( whole, 8192, 64 ), whole );
+    EXPECT_EQ( small.allocate( 4096 ), whole + 4096 );
+    EXPECT_EQ( small.allocate( 2048 ), whole + 2048 );
+}
+
+TEST( BuddyAllocatorTests, TestThroughputForGrowingBuffers )
+{
+    constexpr std::size_t buffers = 64;
+    constexpr std::size_t maxSize = 1 << 16;
+    constexpr std::size_t iterations = 100;
+
+    void* ptrs[buffers];
+
+    BuddyAllocator<24, 6, SingleThreaded> buddy;
+    auto buddyTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < buffers; ++i )
+            ptrs[i] = buddy.allocate( 64 );
+        for ( std::size_t size = 64; size < maxSize; size *= 2 )
+            for ( auto i = 0; i < buffers; ++i )
+                ptrs[i] = buddy.reallocate( ptrs[i], size, size * 2 );
+        for ( auto i = 0; i < buffers; ++i )
+            buddy.deallocate( ptrs[i], maxSize );
+    } );
+
+    auto mallocTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < buffers; ++i )
+            ptrs[i] = malloc( 64 );
+        for ( std::size_t size = 64; size < maxSize; size *= 2 )
+            for ( auto i = 0; i < buffers; ++i )
+                ptrs[i] = realloc( ptrs[i], size * 2 );
+        for ( auto i = 0; i < buffers; ++i )
+            free( ptrs[i] );
+    } );
+
+    std::cerr << "Buddy reallocate: " << buddyTime << std::endl;
+    std::cerr << "Malloc realloc: " << mallocTime << std::endl;
+
+    EXPECT_EQ( buddy.freeNodesPerLevel().front(), 1 );
+}
+
+TEST( BuddyAllocatorTests, TestThroughputForBatchedAllocations )
+{
+    constexpr std::size_t allocations = 1 << 12;
+    constexpr std::size_t allocSize = 128;
+    constexpr std::size_t iterations = 100;
+
+    std::vector<void*> ptrs( allocations );
+
+    BuddyAllocator<24, 6, MultiThreaded> buddy;
+    auto singleTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < allocations; ++i )
+            ptrs[i] = buddy.allocate( allocSize );
+        for ( auto i = 0; i < allocations; ++i )
+            buddy.deallocate( ptrs[i], allocSize );
+    } );
+
+    auto batchTime = bench( iterations, [&]() {
+        auto allocated = buddy.allocateBatch( allocSize, allocations, ptrs.data() );
+        buddy.deallocateBatch( ptrs.data(), allocated, allocSize );
+    } );
+
+    std::cerr << "Single calls: " << singleTime << std::endl;
+    std::cerr << "Batched calls: " << batchTime << std::endl;
+
+    EXPECT_EQ( buddy.freeNodesPerLevel().front(), 1 );
+
+    // a batch larger than the arena stops when it runs out and hands back distinct blocks
+    BuddyAllocator<13, 6, SingleThreaded> small;
+    void* blocks[8];
+    small.allocate( 64 );
+    EXPECT_EQ( small.allocateBatch( 1024, 8, blocks ), 7 );
+    std::sort( blocks, blocks + 7 );
+    EXPECT_EQ( std::adjacent_find( blocks, blocks + 7 ), blocks + 7 );
+    EXPECT_EQ( small.allocate( 64 ), static_cast<uint8_t const*>( small.memoryBegin() ) + 64 );
+}
+
+TEST( BuddyAllocatorTests, TestStatsReportFragmentation )
+{
+    BuddyAllocator<16, 6, SingleThreaded> buddy;
+
+    auto small = buddy.allocate( 100 );
+    auto stats = buddy.stats();
+    EXPECT_EQ( stats.liveBytes, 128 );
+    EXPECT_EQ( stats.requestedBytes, 100 );
+    EXPECT_EQ( stats.roundedBytes, 128 );
+    EXPECT_EQ( stats.freeBytes, ( 1 << 16 ) - 128 );
+    EXPECT_EQ( stats.largestFreeBlock, 1 << 15 );
+    EXPECT_EQ( stats.freeBytesPerLevel[1], 1 << 15 );
+    EXPECT_GT( stats.internalFragmentation(), 0.2 );
+    EXPECT_NEAR( stats.externalFragmentation(), 0.5, 0.01 );
+
+    // almost all of the arena is free, but not as a single block
+    EXPECT_EQ( buddy.allocate( 1 << 16 ), nullptr );
+    EXPECT_EQ( buddy.stats().failedSplits, 1 );
+
+    buddy.deallocate( small );
+    stats = buddy.stats();
+    EXPECT_EQ( stats.liveBytes, 0 );
+    EXPECT_EQ( stats.largestFreeBlock, 1 << 16 );
+    EXPECT_EQ( stats.externalFragmentation(), 0.0 );
+}
+
+TEST( BuddyAllocatorTests, TestThreadCacheIsFlushedOnThreadExit )
+{
+    CachedBuddyAllocator<20, 6> cached;
+
+    std::thread { [&]() {
+        void* ptrs[100];
+        for ( auto i = 0; i < 100; ++i )
+            ptrs[i] = cached.allocate( 64 << ( i % 3 ) );
+        for ( auto i = 0; i < 100; ++i )
+            cached.deallocate( ptrs[i] );
+
+        EXPECT_GT( cached.arena().stats().liveBytes, 0 );
+    } }.join();
+
+    EXPECT_EQ( cached.arena().freeNodesPerLevel().front(), 1 );
+
+    // the calling thread can flush its own cache without exiting
+    cached.deallocate( cached.allocate( 100 ), 100 );
+    cached.flushThreadCache();
+    EXPECT_EQ( cached.arena().freeNodesPerLevel().front(), 1 );
+}
+
+TEST( BuddyAllocatorTests, TestPerLevelLockedFindsFreeSpaceDuringSplitsAndMerges )
+{
+    // at most 8 live 64 byte blocks, the 1 MiB arena never runs out
+    BuddyAllocator<20, 6, PerLevelLocked> buddy;
+    std::atomic<std::size_t> failed { 0 };
+
+    std::vector<std::thread> threads;
+    for ( auto t = 0; t < 8; ++t )
+    {
+        threads.emplace_back( [&]() {
+            for ( auto i = 0; i < 100000; ++i )
+            {
+                auto ptr = buddy.allocate( 64 );
+                if ( !ptr )
+                {
+                    failed.fetch_add( 1, std::memory_order_relaxed );
+                    continue;
+                }
+                buddy.deallocate( ptr );
+            }
+        } );
+    }
+    for ( auto& thread : threads )
+        thread.join();
+
+    EXPECT_EQ( failed.load(), 0 );
+    EXPECT_EQ( buddy.stats().liveBytes, 0 );
+}
+
+#if defined( __linux__ )
+static std::size_t residentPages()
+{
+    std::size_t size = 0, resident = 0;
+    std::ifstream { "/proc/self/statm" } >> size >> resident;
+    return resident;
+}
+
+TEST( BuddyAllocatorTests, TestMappedMemoryReturnsPagesOnCoalesce )
+{
+    constexpr std::size_t allocSize = 1 << 25;
+
+    BuddyAllocator<26, 12, SingleThreaded, MappedMemory<16>> buddy;
+    const auto residentBefore = residentPages();
+
+    auto ptr = static_cast<uint8_t*>( buddy.allocate( allocSize ) );
+    std::memset( ptr, 0xAB, allocSize );
+    const auto residentInUse = residentPages();
+    EXPECT_GE( residentInUse, residentBefore + allocSize / 4096 / 2 );
+
+    buddy.deallocate( ptr );
+    EXPECT_LT( residentPages(), residentInUse - allocSize / 4096 / 2 );
+
+    // dropped pages come back zero filled
+    ptr = static_cast<uint8_t*>( buddy.allocate( allocSize ) );
+    EXPECT_EQ( ptr[0], 0 );
+    buddy.deallocate( ptr );
+}
+#endif
+
+namespace buddy_benchmark_tests
+{
+    template <std::size_t ALLOC_SIZE, class ThreadingPolicy>
+    struct SharedBuddy
+    {
+        using Allocator = BuddyAllocator<26, 6, ThreadingPolicy>;
+
+        static constexpr std::size_t allocSize = ALLOC_SIZE;
+
+        static Allocator& instance()
+        {
+            static Allocator buddy;
+            return buddy;
+        }
+    };
+
+    template <std::size_t N>
+    using MutexBuddy = SharedBuddy<N, MultiThreaded>;
+
+    template <std::size_t N>
+    using PerLevelLockedBuddy = SharedBuddy<N, PerLevelLocked>;
+
+    template <std::size_t ALLOC_SIZE>
+    struct ShardedBuddy
+    {
+        using Allocator = ShardedBuddyAllocator<26, 6, MultiThreaded>;
+
+        static constexpr std::size_t allocSize = ALLOC_SIZE;
+
+        static Allocator& instance()
+        {
+            static Allocator buddy;
+            return buddy;
+        }
+    };
+
+    template <std::size_t ALLOC_SIZE>
+    struct CachedBuddy
+    {
+        using Allocator = CachedBuddyAllocator<26, 6, MultiThreaded>;
+
+        static constexpr std::size_t allocSize = ALLOC_SIZE;
+
+        static Allocator& instance()
+        {
+            static Allocator buddy;
+            return buddy;
+        }
+    };
+
+    // mixes the requested size with its neighbouring levels so splits and merges overlap
+    template <class Shared, std::size_t allocations>
+    static void concurrentAllocDealloc()
+    {
+        auto& buddy = Shared::instance();
+        void* ptrs[allocations];
+        for ( auto i = 0; i < allocations; ++i )
+        {
+            ptrs[i] = buddy.allocate( Shared::allocSize << ( i % 3 ) );
+            ASSERT_NE( ptrs[i], nullptr );
+        }
+        for ( auto i = 0; i < allocations; ++i )
+            buddy.deallocate( ptrs[i] );
+    }
+
+    const std::size_t concurrentAllocations = 64;
+
+    REGISTER_BM_SCALING_TEST(
+        MUTEX_BUDDY_ALLOC,
+        concurrentAllocDealloc,
+        64,
+        MutexBuddy,
+        concurrentAllocations );
+    REGISTER_BM_SCALING_TEST(
+        PER_LEVEL_LOCKED_BUDDY_ALLOC,
+        concurrentAllocDealloc,
+        64,
+        PerLevelLockedBuddy,
+        concurrentAllocations );
+    REGISTER_BM_SCALING_TEST(
+        CACHED_BUDDY_ALLOC,
+        concurrentAllocDealloc,
+        64,
+        CachedBuddy,
+        concurrentAllocations );
+
+    REGISTER_BM_SCALING_TEST(
+        MUTEX_BUDDY_ALLOC,
+        concurrentAllocDealloc,
+        1024,
+        MutexBuddy,
+        concurrentAllocations );
+    REGISTER_BM_SCALING_TEST(
+        PER_LEVEL_LOCKED_BUDDY_ALLOC,
+        concurrentAllocDealloc,
+        1024,
+        PerLevelLockedBuddy,
+        concurrentAllocations );
+    REGISTER_BM_SCALING_TEST(
+        SHARDED_BUDDY_ALLOC,
+        concurrentAllocDealloc,
+        1024,
+        ShardedBuddy,
+        concurrentAllocations );
+}  // namespace buddy_benchmark_tests
@@ -0,0 +1,307 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "LinearAllocator/ConcurrentLinearAllocator.h"
+#include "LinearAllocator/FrameAllocator.h"
+#include "LinearAllocator/LinearAllocator.h"
+
+using namespace allocators;
+
+TEST( LinearAllocatorTests, TestAllocationsAreAligned )
+{
+    LinearAllocator<1024> arena;
+
+    for ( std::size_t alignment = 1; alignment <= 4096; alignment *= 2 )
+    {
+        arena.allocate( 1, 1 );
+        auto ptr = arena.allocate( 24, alignment );
+        EXPECT_EQ( reinterpret_cast<std::uintptr_t>( ptr ) % alignment, 0 );
+    }
+}
+
+TEST( LinearAllocatorTests, TestGrowsByChainingBlocks )
+{
+    LinearAllocator<1024> arena;
+
+    std::vector<char*> ptrs;
+    for ( auto i = 0; i < 100; ++i )
+    {
+        ptrs.push_back( static_cast<char*>( arena.allocate( 100 ) ) );
+        std::memset( ptrs.back(), i, 100 );
+    }
+    EXPECT_GE( arena.capacity(), 100 * 100 );
+
+    for ( auto i = 0; i < 100; ++i )
+        EXPECT_EQ( ptrs[i][99], static_cast<char>( i ) );
+
+    // larger than the next block would be
+    auto large = arena.allocate( 1 << 20 );
+    std::memset( large, 0, 1 << 20 );
+}
+
+TEST( LinearAllocatorTests, TestResetReusesFirstBlockAndTrims )
+{
+    LinearAllocator<1024> arena( 4096 );
+
+    auto first = arena.allocate( 16 );
+    arena.allocate( 1 << 16 );
+    EXPECT_GT( arena.capacity(), 4096 );
+
+    arena.reset();
+    EXPECT_LE( arena.capacity(), 4096 );
+    EXPECT_EQ( arena.allocate( 16 ), first );
+
+    // LIFO deallocations give the memory back right away
+    auto a = arena.allocate( 32 );
+    auto b = arena.allocate( 32 );
+    arena.deallocate( b, 32 );
+    arena.deallocate( a, 32 );
+    EXPECT_EQ( arena.allocate( 32 ), a );
+
+    arena.trim();
+    EXPECT_EQ( arena.capacity(), 1024 );
+}
+
+TEST( LinearAllocatorTests, TestScopedArenaRewindsOnScopeExit )
+{
+    LinearAllocator<1024> arena;
+
+    auto outer = arena.allocate( 64 );
+    auto marker = arena.getMarker();
+    {
+        ScopedArena scope { arena };
+        scope.allocate( 512 );
+        {
+            ScopedArena inner { arena };
+            // spills into a new block, the rewind has to come back to the first one
+            inner.allocate( 4096 );
+        }
+        scope.allocate( 256 );
+    }
+    EXPECT_EQ( arena.allocate( 16 ), static_cast<char*>( outer ) + 64 );
+
+    arena.rewindTo( marker );
+    EXPECT_EQ( arena.allocate( 16 ), static_cast<char*>( outer ) + 64 );
+}
+
+struct Tracked
+{
+    std::vector<int>& destroyed;
+    int id;
+    std::string name;
+
+    Tracked( std::vector<int>& destroyed, int id )
+        : destroyed( destroyed )
+        , id( id )
+        , name( 64, 'x' )
+    {
+    }
+
+    ~Tracked() { destroyed.push_back( id ); }
+};
+
+TEST( LinearAllocatorTests, TestMadeObjectsAreDestroyedInReverseOrder )
+{
+    std::vector<int> destroyed;
+    LinearAllocator<1024> arena;
+
+    arena.make<Tracked>( destroyed, 0 );
+    auto marker = arena.getMarker();
+    for ( auto i = 1; i < 4; ++i )
+    {
+        auto obj = arena.make<Tracked>( destroyed, i );
+        EXPECT_EQ( reinterpret_cast<std::uintptr_t>( obj ) % alignof( Tracked ), 0 );
+        EXPECT_EQ( obj->name.size(), 64 );
+    }
+
+    // trivially destructible objects are placed without a destructor record
+    auto before = static_cast<char*>( arena.allocate( 1, 1 ) );
+    auto value = arena.make<int>( 42 );
+    EXPECT_EQ( *value, 42 );
+    EXPECT_LE( reinterpret_cast<char*>( value ), before + alignof( int ) );
+
+    arena.rewindTo( marker );
+    EXPECT_EQ( destroyed, ( std::vector<int> { 3, 2, 1 } ) );
+
+    arena.reset();
+    EXPECT_EQ( destroyed.back(), 0 );
+}
+
+TEST( LinearAllocatorTests, TestFrameMemoryLivesUntilItsSlotComesAround )
+{
+    std::vector<int> destroyed;
+    FrameAllocator<1024, 3> frames;
+
+    std::vector<char*> ptrs;
+    for ( auto frame = 0; frame < 3; ++frame )
+    {
+        if ( frame > 0 )
+            frames.beginFrame();
+        ptrs.push_back( static_cast<char*>( frames.allocate( 100 ) ) );
+        std::memset( ptrs.back(), frame, 100 );
+        frames.make<Tracked>( destroyed, frame );
+    }
+
+    // all frames still in flight
+    for ( auto frame = 0; frame < 3; ++frame )
+        EXPECT_EQ( ptrs[frame][99], static_cast<char>( frame ) );
+    EXPECT_TRUE( destroyed.empty() );
+
+    // the oldest frame is recycled, the other two are untouched
+    EXPECT_EQ( frames.beginFrame(), 0 );
+    EXPECT_EQ( destroyed, std::vector<int> { 0 } );
+    EXPECT_EQ( frames.allocate( 100 ), ptrs[0] );
+    EXPECT_EQ( ptrs[1][99], 1 );
+    EXPECT_EQ( ptrs[2][99], 2 );
+}
+
+TEST( LinearAllocatorTests, TestThroughputForRequestScratchMemory )
+{
+    constexpr std::size_t allocations = 1 << 12;
+    constexpr std::size_t iterations = 100;
+
+    std::vector<void*> ptrs( allocations );
+    std::vector<std::size_t> sizes( allocations );
+    for ( auto i = 0; i < allocations; ++i )
+        sizes[i] = 16 + i % 256;
+
+    LinearAllocator<1 << 16> arena;
+    auto arenaTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < allocations; ++i )
+            ptrs[i] = arena.allocate( sizes[i] );
+        arena.reset();
+    } );
+
+    auto scopedTime = bench( iterations, [&]() {
+        ScopedArena scope { arena };
+        for ( auto i = 0; i < allocations; ++i )
+            ptrs[i] = scope.allocate( sizes[i] );
+    } );
+
+    auto mallocTime = bench( iterations, [&]() {
+        for ( auto i = 0; i < allocations; ++i )
+            ptrs[i] = malloc( sizes[i] );
+        for ( auto i = 0; i < allocations; ++i )
+            free( ptrs[i] );
+    } );
+
+    std::cerr << "Linear time: " << arenaTime << std::endl;
+    std::cerr << "Scoped time: " << scopedTime << std::endl;
+    std::cerr << "Malloc time: " << mallocTime << std::endl;
+
+    EXPECT_LE( arenaTime, mallocTime );
+}
+
+TEST( LinearAllocatorTests, TestConcurrentAllocationsDontOverlap )
+{
+    constexpr std::size_t threads = 8;
+    constexpr std::size_t allocations = 10000;
+
+    ConcurrentLinearAllocator<> arena( 1 << 26 );
+
+    std::mutex mutex;
+    std::vector<std::pair<char*, std::size_t>> ranges;
+    bench_multithreaded(
+        threads,
+        [&]() {
+            std::vector<std::pair<char*, std::size_t>> local;
+            for ( std::size_t i = 0; i < allocations; ++i )
+            {
+                const auto size = 1 + i % 200;
+                auto ptr = static_cast<char*>( arena.allocate( size, 8 ) );
+                EXPECT_EQ( reinterpret_cast<std::uintptr_t>( ptr ) % 8, 0 );
+                local.emplace_back( ptr, size );
+            }
+            // an allocation larger than half a sub-block is claimed on its own
+            local.emplace_back( static_cast<char*>( arena.allocate( 1 << 16 ) ), 1 << 16 );
+
+            std::lock_guard<std::mutex> guard { mutex };
+            ranges.insert( std::end( ranges ), std::begin( local ), std::end( local ) );
+        },
+        threads );
+
+    std::sort( std::begin( ranges ), std::end( ranges ) );
+    for ( std::size_t i = 1; i < ranges.size(); ++i )
+        EXPECT_LE( ranges[i - 1].first + ranges[i - 1].second, ranges[i].first );
+
+    arena.reset();
+    EXPECT_EQ( arena.claimed(), 0 );
+    EXPECT_THROW( arena.allocate( 1 << 27 ), std::bad_alloc );
+}
+
+TEST( LinearAllocatorTests, TestExhaustedArenaHandsOutNoStaleSubBlock )
+{
+    constexpr std::size_t subBlock = 1 << 12;
+    ConcurrentLinearAllocator<subBlock> a( 4 * subBlock );
+    ConcurrentLinearAllocator<subBlock> b( 4 * subBlock );
+
+    const auto exhaust = [&a]() {
+        std::thread { [&a]() {
+            try
+            {
+                for ( ;; )
+                    a.allocate( subBlock / 4 );
+            }
+            catch ( std::bad_alloc const& )
+            {
+            }
+        } }.join();
+    };
+
+    // this thread's sub-block goes away with the reset, another thread then takes everything
+    EXPECT_NE( a.allocate( 16 ), nullptr );
+    a.reset();
+    exhaust();
+    EXPECT_THROW( a.allocate( 16 ), std::bad_alloc );
+    EXPECT_THROW( a.allocate( 16 ), std::bad_alloc );
+
+    // a sub-block of another arena must not be used for a either
+    EXPECT_NE( b.allocate( 16 ), nullptr );
+    EXPECT_THROW( a.allocate( 16 ), std::bad_alloc );
+    EXPECT_THROW( a.allocate( 16 ), std::bad_alloc );
+
+    a.reset();
+    EXPECT_NE( a.allocate( 16 ), nullptr );
+    EXPECT_EQ( a.claimed(), subBlock );
+}
+
+TEST( LinearAllocatorTests, TestConcurrentThroughputScaling )
+{
+    constexpr std::size_t allocations = 64;
+    constexpr std::size_t allocSize = 64;
+    constexpr std::size_t iterations = 64 * 100;
+
+    ConcurrentLinearAllocator<> arena( 1 << 28 );
+    for ( std::size_t threads = 1; threads <= 64; threads *= 2 )
+    {
+        auto arenaTime = bench_multithreaded(
+            iterations,
+            [&]() {
+                for ( std::size_t i = 0; i < allocations; ++i )
+                    arena.allocate( allocSize );
+            },
+            threads );
+        arena.reset();
+
+        auto mallocTime = bench_multithreaded(
+            iterations,
+            [&]() {
+                void* ptrs[allocations];
+                for ( std::size_t i = 0; i < allocations; ++i )
+                    ptrs[i] = malloc( allocSize );
+                for ( std::size_t i = 0; i < allocations; ++i )
+                    free( ptrs[i] );
+            },
+            threads );
+
+        std::cerr << threads << " threads, concurrent linear: " << arenaTime
+                  << " malloc: " << mallocTime << std::endl;
+    }
+}
@@ -1,10 +1,21 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
 #include "Benchmark.h"
+#include "SmallObjectAllocator/FixedAllocator.h"
 #include "SmallObjectAllocator/SmallObject.h"
 #include "SmallObjectAllocator/SmallValueObject.h"
+#include "SmallObjectAllocator/SuperblockPool.h"
 
 using namespace allocators;
 
@@ -37,12 +48,49 @@ namespace benchmark_tests
         DEFAULT_ALIGN_SIZE,
         DEFAULT_MUTEX>;
 
+    using ThreadCachedSmallObjBase = SmallObject<
+        ThreadCached,
+        DEFAULT_CHUNK_SIZE,
+        MAX_SMALL_OBJECT_SIZE,
+        DEFAULT_ALIGN_SIZE,
+        DEFAULT_MUTEX>;
+
+    using LockFreeSmallObjBase = SmallObject<
+        LockFree,
+        DEFAULT_CHUNK_SIZE,
+        MAX_SMALL_OBJECT_SIZE,
+        DEFAULT_ALIGN_SIZE,
+        DEFAULT_MUTEX>;
+
+    using PerCpuSmallObjBase = SmallObject<
+        PerCpu,
+        DEFAULT_CHUNK_SIZE,
+        MAX_SMALL_OBJECT_SIZE,
+        DEFAULT_ALIGN_SIZE,
+        DEFAULT_MUTEX>;
+
+    using OwnedHeapsSmallObjBase = SmallObject<
+        OwnedHeaps,
+        DEFAULT_CHUNK_SIZE,
+        MAX_SMALL_OBJECT_SIZE,
+        DEFAULT_ALIGN_SIZE,
+        DEFAULT_MUTEX>;
+
     template <std::size_t N>
     using MySmallObj = TestObject<SingleThreadSmallObjBase, N>;
 
     template <std::size_t N>
     using MySmallObjMulti = TestObject<MultiThreadSmallObjBase, N>;
 
+    template <std::size_t N>
+    using MySmallObjCached = TestObject<ThreadCachedSmallObjBase, N>;
+
+    template <std::size_t N>
+    using MySmallObjLockFree = TestObject<LockFreeSmallObjBase, N>;
+
+    template <std::size_t N>
+    using MySmallObjPerCpu = TestObject<PerCpuSmallObjBase, N>;
+
     template <std::size_t N>
     using EmptyBaseTestObj = TestObject<EmptyBase, N>;
 
@@ -301,4 +349,639 @@ namespace benchmark_tests
             EmptyBaseTestObj,
             mediumAllocSize);
     }  // namespace
-}  // namespace benchmark_tests
\ No newline at end of file
+
+    namespace  // linked list medium alloc tests with thread magazines
+    {
+        REGISTER_BM_MULTI_TEST(
+            CACHED_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            2,
+            MySmallObjCached,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            CACHED_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            3,
+            MySmallObjCached,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            CACHED_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            5,
+            MySmallObjCached,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            CACHED_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            17,
+            MySmallObjCached,
+            mediumAllocSize);
+    }  // namespace
+
+    namespace  // linked list medium alloc tests with lock free free lists
+    {
+        REGISTER_BM_MULTI_TEST(
+            LOCKFREE_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            2,
+            MySmallObjLockFree,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            LOCKFREE_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            3,
+            MySmallObjLockFree,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            LOCKFREE_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            5,
+            MySmallObjLockFree,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            LOCKFREE_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            17,
+            MySmallObjLockFree,
+            mediumAllocSize);
+    }  // namespace
+
+    namespace  // linked list medium alloc tests with per cpu shards
+    {
+        REGISTER_BM_MULTI_TEST(
+            PERCPU_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            2,
+            MySmallObjPerCpu,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            PERCPU_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            3,
+            MySmallObjPerCpu,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            PERCPU_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            5,
+            MySmallObjPerCpu,
+            mediumAllocSize);
+        REGISTER_BM_MULTI_TEST(
+            PERCPU_LINKED_LIST_MEDIUM_ALLOC,
+            create_linked_list,
+            17,
+            MySmallObjPerCpu,
+            mediumAllocSize);
+    }  // namespace
+
+    namespace  // mutex vs lock free vs magazines vs per cpu shards from 1 to 64 threads
+    {
+        REGISTER_BM_SCALING_TEST(
+            SMALL_LINKED_LIST_SMALL_ALLOC,
+            create_linked_list,
+            17,
+            MySmallObjMulti,
+            smallAllocSize);
+        REGISTER_BM_SCALING_TEST(
+            LOCKFREE_LINKED_LIST_SMALL_ALLOC,
+            create_linked_list,
+            17,
+            MySmallObjLockFree,
+            smallAllocSize);
+        REGISTER_BM_SCALING_TEST(
+            CACHED_LINKED_LIST_SMALL_ALLOC,
+            create_linked_list,
+            17,
+            MySmallObjCached,
+            smallAllocSize);
+        REGISTER_BM_SCALING_TEST(
+            PERCPU_LINKED_LIST_SMALL_ALLOC,
+            create_linked_list,
+            17,
+            MySmallObjPerCpu,
+            smallAllocSize);
+    }  // namespace
+
+    template <class IndexType>
+    static void tiny_objects_chunks_and_throughput( const char* name )
+    {
+        constexpr std::size_t blockSize = 4;
+        constexpr std::size_t pageSize = 4096;
+        constexpr std::size_t objects = 100000;
+
+        FixedAllocator<IndexType> allocator;
+        allocator.init( blockSize, pageSize );
+
+        std::vector<void*> ptrs( objects );
+        auto time = bench( 10, [&]() {
+            for ( auto& ptr : ptrs )
+                ptr = allocator.allocate();
+            for ( auto ptr : ptrs )
+                allocator.deallocate( ptr, nullptr );
+        } );
+
+        for ( auto& ptr : ptrs )
+            ptr = allocator.allocate();
+        std::cerr << name << ": " << allocator.blocksPerChunk() << " blocks per chunk, "
+                  << allocator.chunkCount() << " chunks for " << objects
+                  << " objects, alloc/free finished for: " << time << std::endl;
+        for ( auto ptr : ptrs )
+            allocator.deallocate( ptr, nullptr );
+    }
+
+    TEST( Benchmark, TINY_OBJECTS_CHUNK_INDEX_TYPES )
+    {
+        tiny_objects_chunks_and_throughput<std::uint8_t>( "uint8_t index" );
+        tiny_objects_chunks_and_throughput<std::uint16_t>( "uint16_t index" );
+        tiny_objects_chunks_and_throughput<std::uint32_t>( "uint32_t index" );
+    }
+
+    template <class Allocator>
+    static void random_order_frees( const char* name )
+    {
+        constexpr std::size_t blockSize = 8;
+        constexpr std::size_t pageSize = 256;
+        constexpr std::size_t objects = 400000;
+        constexpr std::size_t timedFrees = 20000;
+
+        Allocator allocator;
+        allocator.init( blockSize, pageSize );
+
+        std::vector<void*> ptrs( objects );
+        for ( auto& ptr : ptrs )
+            ptr = allocator.allocate();
+        const auto chunks = allocator.chunkCount();
+
+        std::vector<std::size_t> order( objects );
+        for ( std::size_t i = 0; i < objects; ++i )
+            order[i] = i;
+        std::shuffle( std::begin( order ), std::end( order ), std::mt19937 { 42 } );
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for ( std::size_t i = 0; i < timedFrees; ++i )
+        {
+            allocator.deallocate( ptrs[order[i]], nullptr );
+            ptrs[order[i]] = nullptr;
+        }
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        // the rest in allocation order, which the locality guess handles
+        for ( auto ptr : ptrs )
+            if ( ptr )
+                allocator.deallocate( ptr, nullptr );
+
+        const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>( end - start );
+        std::cerr << name << ": " << chunks << " chunks, random order free finished for: "
+                  << time.count() / timedFrees << " ns per free" << std::endl;
+    }
+
+    TEST( Benchmark, RANDOM_ORDER_FREES_WITH_ALIGNED_CHUNKS )
+    {
+        random_order_frees<FixedAllocator<std::uint8_t>>( "scanned chunks" );
+        random_order_frees<FixedAllocator<std::uint8_t, AlignedAllocationPolicy>>(
+            "aligned chunks" );
+    }
+
+    static void sizeless_frees()
+    {
+        constexpr std::size_t objects = 20000;
+
+        // sizes past MAX_SMALL_OBJECT_SIZE come from the default allocator
+        auto& allocator = MultiThreadSmallObjBase::SmallObjAllocSingleton::instance();
+        std::vector<void*> ptrs( objects );
+        for ( std::size_t i = 0; i < objects; ++i )
+        {
+            const auto size = i % ( MAX_SMALL_OBJECT_SIZE + 64 ) + 1;
+            ptrs[i] = allocator.allocate( size );
+            static_cast<char*>( ptrs[i] )[size - 1] = 1;
+        }
+
+        std::shuffle( std::begin( ptrs ), std::end( ptrs ), std::mt19937 { 42 } );
+        for ( auto ptr : ptrs )
+            allocator.deallocate( ptr );
+    }
+
+    TEST( Benchmark, SIZELESS_FREES_WITH_PAGE_MAP )
+    {
+        for ( std::size_t threads = 1; threads <= 8; threads *= 2 )
+        {
+            auto time = bench_multithreaded( 8 * threads, sizeless_frees, threads );
+            std::cerr << "Test sizeless frees with " << threads
+                      << " threads finished for: " << time << std::endl;
+        }
+        EXPECT_FALSE( MultiThreadSmallObjBase::SmallObjAllocSingleton::isCorrupt() );
+    }
+
+    // 255 blocks of the small classes fill less than a page of the page map
+    class Uint8IndexAllocator
+        : public SmallObjectAllocator<SingleThreaded, DEFAULT_MUTEX, std::uint8_t>
+    {
+    public:
+        Uint8IndexAllocator()
+            : SmallObjectAllocator( 4096, 64, 4 )
+        {
+        }
+    };
+
+    TEST( Benchmark, UINT8_INDEX_CHUNKS_COVER_WHOLE_MAP_PAGES )
+    {
+        Uint8IndexAllocator allocator;
+        constexpr std::size_t objects = 3000;
+
+        std::vector<std::pair<void*, std::size_t>> ptrs;
+        for ( std::size_t i = 0; i < objects; ++i )
+        {
+            const std::size_t size = 4 + i % 3 * 20;
+            ptrs.emplace_back( allocator.allocate( size ), size );
+            ASSERT_NE( ptrs.back().first, nullptr );
+            static_cast<char*>( ptrs.back().first )[size - 1] = 1;
+        }
+
+        std::shuffle( std::begin( ptrs ), std::end( ptrs ), std::mt19937 { 42 } );
+        for ( std::size_t i = 0; i < objects; ++i )
+        {
+            if ( i % 2 )
+                allocator.deallocate( ptrs[i].first );
+            else
+                allocator.deallocate( ptrs[i].first, ptrs[i].second );
+        }
+        EXPECT_FALSE( allocator.corrupt() );
+    }
+
+    static void allocation_latency_with_scattered_free_blocks()
+    {
+        constexpr std::size_t blockSize = 8;
+        constexpr std::size_t pageSize = 256;
+        constexpr std::size_t objects = 400000;
+
+        FixedAllocator<std::uint8_t> allocator;
+        allocator.init( blockSize, pageSize );
+
+        std::vector<void*> ptrs( objects );
+        for ( auto& ptr : ptrs )
+            ptr = allocator.allocate();
+        const auto chunks = allocator.chunkCount();
+
+        // one free block in every 8th chunk, the allocations below keep looking for the next one
+        const auto stride = allocator.blocksPerChunk() * 8;
+        std::vector<std::size_t> freed;
+        for ( std::size_t i = 0; i < objects; i += stride )
+        {
+            allocator.deallocate( ptrs[i], nullptr );
+            freed.push_back( i );
+        }
+
+        std::vector<long long> latencies;
+        for ( auto i : freed )
+        {
+            const auto start = std::chrono::high_resolution_clock::now();
+            ptrs[i] = allocator.allocate();
+            const auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count() );
+        }
+        EXPECT_FALSE( allocator.isCorrupt() );
+
+        for ( auto ptr : ptrs )
+            allocator.deallocate( ptr, nullptr );
+
+        std::sort( std::begin( latencies ), std::end( latencies ) );
+        std::cerr << chunks << " chunks, allocation latency p50: "
+                  << latencies[latencies.size() / 2]
+                  << " ns p99: " << latencies[latencies.size() * 99 / 100]
+                  << " ns max: " << latencies.back() << " ns" << std::endl;
+    }
+
+    TEST( Benchmark, ALLOCATION_LATENCY_WITH_MOSTLY_FULL_CHUNKS )
+    {
+        allocation_latency_with_scattered_free_blocks();
+    }
+
+    template <class Policy>
+    static void chunk_provisioning( const char* name )
+    {
+        constexpr std::size_t objects = 1 << 20;
+        constexpr std::size_t pageSize = 4096;
+
+        auto& pool = SuperblockPool::instance();
+        const auto superblocks = pool.superblocks();
+        const auto upstreamCalls = pool.upstreamCalls();
+
+        // a few size classes side by side, as in a SmallObjectAllocator
+        std::array<FixedAllocator<std::uint16_t, Policy>, 4> allocators;
+        for ( std::size_t i = 0; i < allocators.size(); ++i )
+            allocators[i].init( 8 << i, pageSize );
+
+        std::vector<void*> ptrs( objects );
+        const auto start = std::chrono::high_resolution_clock::now();
+        for ( std::size_t i = 0; i < objects; ++i )
+            ptrs[i] = allocators[i % allocators.size()].allocate();
+
+        std::size_t chunks = 0;
+        for ( auto const& allocator : allocators )
+            chunks += allocator.chunkCount();
+
+        for ( std::size_t i = 0; i < objects; ++i )
+            allocators[i % allocators.size()].deallocate( ptrs[i], nullptr );
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        // without superblocks every chunk is its own upstream allocation
+        const auto calls = std::is_same_v<Policy, SuperblockAllocationPolicy>
+            ? pool.upstreamCalls() - upstreamCalls
+            : chunks;
+        const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>( end - start );
+        std::cerr << name << ": " << chunks << " chunks, " << calls
+                  << " upstream allocations, alloc/free finished for: " << time.count()
+                  << std::endl;
+
+        // with the last empty chunks gone the superblocks went back upstream
+        for ( auto& allocator : allocators )
+            allocator.freeEmptyChunk();
+        EXPECT_EQ( pool.superblocks(), superblocks );
+    }
+
+    TEST( Benchmark, CHUNKS_FROM_SUPERBLOCKS )
+    {
+        chunk_provisioning<AlignedAllocationPolicy>( "chunk per allocation" );
+        chunk_provisioning<SuperblockAllocationPolicy>( "chunks from superblocks" );
+    }
+
+    TEST( Benchmark, MAGAZINES_ARE_DRAINED_ON_THREAD_EXIT )
+    {
+        using Singleton = ThreadCachedSmallObjBase::SmallObjAllocSingleton;
+        auto& allocator = Singleton::instance();
+
+        // blocks freed here, by other threads and by the exiting threads' magazines
+        std::vector<void*> ptrs( 10000 );
+        for ( auto& ptr : ptrs )
+            ptr = allocator.allocate( 24 );
+
+        std::vector<std::thread> threads;
+        for ( std::size_t t = 0; t < 4; ++t )
+        {
+            threads.emplace_back( [&, t]() {
+                for ( auto i = t; i < ptrs.size(); i += 4 )
+                    allocator.deallocate( ptrs[i], 24 );
+                for ( std::size_t i = 0; i < 1000; ++i )
+                    allocator.deallocate( allocator.allocate( 24 ) );
+            } );
+        }
+        for ( auto& thread : threads )
+            thread.join();
+
+        allocator.flushThreadCache();
+        EXPECT_FALSE( Singleton::isCorrupt() );
+    }
+
+    TEST( Benchmark, LOCK_FREE_LISTS_HAND_OUT_EACH_BLOCK_ONCE )
+    {
+        using Singleton = LockFreeSmallObjBase::SmallObjAllocSingleton;
+        auto& allocator = Singleton::instance();
+
+        std::vector<std::thread> threads;
+        for ( std::size_t t = 0; t < 8; ++t )
+        {
+            threads.emplace_back( [&allocator, t]() {
+                std::vector<std::size_t*> ptrs( 1000 );
+                for ( std::size_t round = 0; round < 100; ++round )
+                {
+                    for ( std::size_t i = 0; i < ptrs.size(); ++i )
+                    {
+                        ptrs[i] = static_cast<std::size_t*>( allocator.allocate( 16 ) );
+                        *ptrs[i] = t * ptrs.size() + i;
+                    }
+                    for ( std::size_t i = 0; i < ptrs.size(); ++i )
+                    {
+                        EXPECT_EQ( *ptrs[i], t * ptrs.size() + i );
+                        allocator.deallocate( ptrs[i], 16 );
+                    }
+                }
+            } );
+        }
+        for ( auto& thread : threads )
+            thread.join();
+
+        EXPECT_FALSE( Singleton::isCorrupt() );
+    }
+
+    TEST( Benchmark, LOCK_FREE_LISTS_GIVE_THEIR_CHUNKS_BACK )
+    {
+        using Singleton = LockFreeSmallObjBase::SmallObjAllocSingleton;
+        auto& allocator = Singleton::instance();
+        auto& pool = SuperblockPool::instance();
+
+        // far more than the free slots other tests left in the superblocks
+        std::vector<void*> ptrs( 1 << 20 );
+        for ( auto& ptr : ptrs )
+            ptr = allocator.allocate( 40 );
+        for ( auto ptr : ptrs )
+            allocator.deallocate( ptr, 40 );
+
+        // the freed blocks sit on the stack of their class until it is reclaimed
+        const auto superblocks = pool.superblocks();
+        Singleton::removeExtraMemory();
+        EXPECT_LT( pool.superblocks(), superblocks );
+        EXPECT_FALSE( Singleton::isCorrupt() );
+
+        for ( auto& ptr : ptrs )
+            ptr = allocator.allocate( 40 );
+        for ( auto ptr : ptrs )
+            allocator.deallocate( ptr, 40 );
+        EXPECT_FALSE( Singleton::isCorrupt() );
+    }
+
+    TEST( Benchmark, LOCK_FREE_LISTS_RECLAIMED_WHILE_IN_USE )
+    {
+        using Singleton = LockFreeSmallObjBase::SmallObjAllocSingleton;
+        auto& allocator = Singleton::instance();
+
+        std::atomic<bool> finished { false };
+        std::thread reclaimer( [&finished]() {
+            while ( !finished.load() )
+            {
+                Singleton::removeExtraMemory();
+                std::this_thread::yield();
+            }
+        } );
+
+        std::vector<std::thread> threads;
+        for ( std::size_t t = 0; t < 4; ++t )
+        {
+            threads.emplace_back( [&allocator, t]() {
+                std::vector<std::size_t*> ptrs( 500 );
+                for ( std::size_t round = 0; round < 100; ++round )
+                {
+                    for ( std::size_t i = 0; i < ptrs.size(); ++i )
+                    {
+                        ptrs[i] = static_cast<std::size_t*>( allocator.allocate( 32 ) );
+                        *ptrs[i] = t * ptrs.size() + i;
+                    }
+                    for ( std::size_t i = 0; i < ptrs.size(); ++i )
+                    {
+                        EXPECT_EQ( *ptrs[i], t * ptrs.size() + i );
+                        allocator.deallocate( ptrs[i], 32 );
+                    }
+                }
+            } );
+        }
+        for ( auto& thread : threads )
+            thread.join();
+        finished = true;
+        reclaimer.join();
+
+        EXPECT_FALSE( Singleton::isCorrupt() );
+    }
+
+    // the free lists link blocks through their first bytes, even those of the 4 byte class,
+    // and every block of a class must be aligned for that link, even those of the 12 and 20
+    // byte ones. Every other block is freed by another thread, a remote free for owned heaps.
+    template <class Base>
+    static void tiny_blocks_on_free_lists( std::size_t classSize )
+    {
+        using Singleton = typename Base::SmallObjAllocSingleton;
+        auto& allocator = Singleton::instance();
+        const auto size = [classSize]( std::size_t i ) { return classSize - i % 4; };
+
+        std::vector<char*> ptrs( 4000 );
+        for ( std::size_t i = 0; i < ptrs.size(); ++i )
+        {
+            ptrs[i] = static_cast<char*>( allocator.allocate( size( i ) ) );
+            EXPECT_EQ(
+                reinterpret_cast<std::uintptr_t>( ptrs[i] ) % alignof( std::atomic<void*> ), 0u );
+            std::fill_n( ptrs[i], size( i ), char( i ) );
+        }
+
+        std::thread( [&allocator, &ptrs, &size]() {
+            for ( std::size_t i = 0; i < ptrs.size(); i += 2 )
+                allocator.deallocate( ptrs[i], size( i ) );
+        } ).join();
+
+        for ( std::size_t i = 1; i < ptrs.size(); i += 2 )
+        {
+            EXPECT_EQ( ptrs[i][size( i ) - 1], char( i ) );
+            allocator.deallocate( ptrs[i], size( i ) );
+        }
+
+        allocator.flushThreadCache();
+        EXPECT_FALSE( Singleton::isCorrupt() );
+    }
+
+    TEST( Benchmark, TINY_BLOCKS_ON_FREE_LISTS )
+    {
+        tiny_blocks_on_free_lists<LockFreeSmallObjBase>( 4 );
+        tiny_blocks_on_free_lists<LockFreeSmallObjBase>( 12 );
+        tiny_blocks_on_free_lists<OwnedHeapsSmallObjBase>( 4 );
+        tiny_blocks_on_free_lists<OwnedHeapsSmallObjBase>( 12 );
+        tiny_blocks_on_free_lists<OwnedHeapsSmallObjBase>( 20 );
+    }
+
+    TEST( Benchmark, PER_CPU_FREES_GO_BACK_TO_THE_OWNING_SHARD )
+    {
+        using Singleton = PerCpuSmallObjBase::SmallObjAllocSingleton;
+        auto& allocator = Singleton::instance();
+
+        // every thread frees the blocks of the next one, which likely ran on another cpu
+        constexpr std::size_t threadCount = 8;
+        constexpr std::size_t blockCount = 10000;
+        std::vector<std::vector<void*>> blocks( threadCount );
+        for ( auto& threadBlocks : blocks )
+            threadBlocks.resize( blockCount );
+
+        const auto run = [&allocator, &blocks]( auto&& body ) {
+            std::vector<std::thread> threads;
+            for ( std::size_t t = 0; t < threadCount; ++t )
+                threads.emplace_back( body, t );
+            for ( auto& thread : threads )
+                thread.join();
+        };
+
+        run( [&allocator, &blocks]( std::size_t t ) {
+            for ( auto& block : blocks[t] )
+                block = allocator.allocate( 24 );
+        } );
+        run( [&allocator, &blocks]( std::size_t t ) {
+            for ( auto block : blocks[( t + 1 ) % threadCount] )
+                allocator.deallocate( block, 24 );
+        } );
+
+        EXPECT_FALSE( Singleton::isCorrupt() );
+    }
+
+    // one thread allocates messages in batches, another frees them
+    template <class Base>
+    static void producer_consumer( const char* name )
+    {
+        constexpr std::size_t messageSize = 48;
+        constexpr std::size_t batchSize = 256;
+        constexpr std::size_t batches = 4000;
+        constexpr std::size_t maxQueued = 16;
+
+        auto& allocator = Base::SmallObjAllocSingleton::instance();
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<std::vector<void*>> queue;
+        bool done = false;
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::thread consumer( [&]() {
+            while ( true )
+            {
+                std::vector<void*> batch;
+                {
+                    std::unique_lock<std::mutex> lock { mutex };
+                    changed.wait( lock, [&]() { return done || !queue.empty(); } );
+                    if ( queue.empty() )
+                        return;
+
+                    batch = std::move( queue.back() );
+                    queue.pop_back();
+                }
+                changed.notify_all();
+
+                for ( auto message : batch )
+                    allocator.deallocate( message, messageSize );
+            }
+        } );
+
+        for ( std::size_t i = 0; i < batches; ++i )
+        {
+            std::vector<void*> batch( batchSize );
+            for ( auto& message : batch )
+            {
+                message = allocator.allocate( messageSize );
+                static_cast<char*>( message )[messageSize - 1] = 1;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock { mutex };
+                changed.wait( lock, [&]() { return queue.size() < maxQueued; } );
+                queue.push_back( std::move( batch ) );
+            }
+            changed.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            done = true;
+        }
+        changed.notify_all();
+        consumer.join();
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        allocator.flushThreadCache();
+
+        const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>( end - start );
+        std::cerr << name << ": producer/consumer finished for: "
+                  << time.count() / ( batches * batchSize ) << " ns per message" << std::endl;
+    }
+
+    TEST( Benchmark, PRODUCER_CONSUMER_WITH_REMOTE_FREES )
+    {
+        producer_consumer<MultiThreadSmallObjBase>( "locked frees" );
+        producer_consumer<ThreadCachedSmallObjBase>( "magazines" );
+        producer_consumer<OwnedHeapsSmallObjBase>( "remote frees" );
+
+        EXPECT_FALSE( OwnedHeapsSmallObjBase::SmallObjAllocSingleton::isCorrupt() );
+    }
+}  // namespace benchmark_tests